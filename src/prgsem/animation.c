@@ -0,0 +1,297 @@
+
+#include "animation.h"
+#include "juliaset_batch.h"
+#include "palette.h"
+#include "render_pool.h"
+
+#include <threads.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/* Frames travel through three stages, each running on its own thread: computation of
+ iteration counts (spread over the render pool), coloring by the palette and writing.
+ A frame occupies one slot from computation until it is written, so three slots
+ keep all stages busy. */
+enum { slot_count = 3 };
+
+enum slot_state {
+	slot_free, //Waits for the computation of the next frame
+	slot_computed, //Holds iteration counts, waits for coloring
+	slot_colored //Holds rgb data, waits for writing
+};
+
+struct slot {
+	uint16_t* counts;
+	uint8_t* rgb;
+	enum slot_state state;
+};
+
+struct pipeline {
+	struct animation const* a;
+	mtx_t lock; //Protects states of slots and 'failed'
+	cnd_t changed;
+	struct slot slots[slot_count];
+	bool failed; //Set by the writer, stops the other stages
+	double busy[3]; //Seconds spent working by each stage
+};
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+//Waits until the slot of given frame gets to 'state'. Returns false if the pipeline failed.
+static bool wait_for(struct pipeline* p, int frame, enum slot_state state) {
+	struct slot* const s = &p->slots[frame % slot_count];
+	mtx_lock(&p->lock);
+	while (s->state != state && !p->failed) {
+		cnd_wait(&p->changed, &p->lock);
+	}
+	bool const ok = !p->failed;
+	mtx_unlock(&p->lock);
+	return ok;
+}
+
+static void pass_on(struct pipeline* p, int frame, enum slot_state state) {
+	mtx_lock(&p->lock);
+	p->slots[frame % slot_count].state = state;
+	cnd_broadcast(&p->changed);
+	mtx_unlock(&p->lock);
+}
+
+static void fail(struct pipeline* p) {
+	mtx_lock(&p->lock);
+	p->failed = true;
+	cnd_broadcast(&p->changed);
+	mtx_unlock(&p->lock);
+}
+
+static my_complex lerp(my_complex from, my_complex to, double t) {
+	return add(from, scalar_mul(sub(to, from), t));
+}
+
+//Everything a row task needs to know about the frame being computed
+struct frame_view {
+	int width, precision;
+	my_complex top_left, c;
+	double dx, dy;
+	bool use_float;
+	uint16_t* counts;
+};
+
+static void compute_row(int row, int worker, void* arg) {
+	struct frame_view const* const v = arg;
+	int iterations[v->width];
+	my_complex const start = { v->top_left.re, v->top_left.im - row * v->dy };
+	(v->use_float ? &convergence_test_row_float : &convergence_test_row)(start, v->dx, 0, 1, v->width, v->c,
+		v->precision, 0.0, iterations, NULL);
+	uint16_t* const counts = v->counts + row * v->width;
+	for (int i = 0; i < v->width; ++i) {
+		counts[i] = iterations[i];
+	}
+}
+
+static void compute_frame(struct pipeline* p, int frame) {
+	struct animation const* const a = p->a;
+	double const t = a->frames > 1 ? (double)frame / (a->frames - 1) : 0.0;
+	my_complex const top_left = lerp(a->top_left_from, a->top_left_to, t);
+	my_complex const bottom_right = lerp(a->bottom_right_from, a->bottom_right_to, t);
+	struct frame_view view = {
+		a->width, a->precision, top_left, lerp(a->c_from, a->c_to, t),
+		(bottom_right.re - top_left.re) / a->width, (top_left.im - bottom_right.im) / a->height,
+		false, p->slots[frame % slot_count].counts
+	};
+	view.use_float = batch_float_sufficient(view.dx) && batch_float_sufficient(view.dy);
+
+	int rows[a->height];
+	for (int row = 0; row < a->height; ++row) {
+		rows[row] = row;
+	}
+	if (pool_size() > 1) {
+		pool_run(rows, a->height, &compute_row, &view);
+	}
+	else {
+		for (int row = 0; row < a->height; ++row) {
+			compute_row(row, 0, &view);
+		}
+	}
+}
+
+static int coloring_stage(void* arg) {
+	struct pipeline* const p = arg;
+	int const pixels = p->a->width * p->a->height;
+	for (int frame = 0; frame < p->a->frames && wait_for(p, frame, slot_computed); ++frame) {
+		double const start = now();
+		struct slot* const s = &p->slots[frame % slot_count];
+		palette_color_counts(s->counts, pixels, s->rgb);
+		p->busy[1] += now() - start;
+		pass_on(p, frame, slot_colored);
+	}
+	return 0;
+}
+
+/* Returns true iff the pattern contains exactly one conversion and it takes an int (e.g. %05d).
+ Without one all frames would overwrite a single file, others would read missing arguments. */
+static bool valid_name_pattern(char const* pattern) {
+	int conversions = 0;
+	for (char const* p = pattern; *p; ++p) {
+		if (*p != '%' || *++p == '%') {
+			continue;
+		}
+		p += strspn(p, "-+ #0");
+		p += strspn(p, "0123456789");
+		if (*p != 'd' && *p != 'i') {
+			return false;
+		}
+		++conversions;
+	}
+	return conversions == 1;
+}
+
+static bool write_ppm(struct animation const* a, int frame, uint8_t const* rgb) {
+	char name[1024];
+	if (snprintf(name, sizeof name, a->output, frame) >= (int)sizeof name) {
+		fprintf(stderr, "ERROR: Name of frame %d is too long.\r\n", frame);
+		return false;
+	}
+	FILE* const output = fopen(name, "wb");
+	if (!output) {
+		fprintf(stderr, "ERROR: Cannot open %s for writing.\r\n", name);
+		return false;
+	}
+	fprintf(output, "P6\n%d\n%d\n255\n", a->width, a->height);
+	size_t const pixels = (size_t)a->width * a->height;
+	bool const ok = fwrite(rgb, 3, pixels, output) == pixels;
+	return !fclose(output) && ok;
+}
+
+//Converts to BT.601 limited range Y'CbCr and writes the three planes
+static bool write_y4m_frame(FILE* output, int pixels, uint8_t const* rgb, uint8_t* planes) {
+	uint8_t* const y = planes, * const cb = planes + pixels, * const cr = planes + 2 * pixels;
+	for (int i = 0; i < pixels; ++i) {
+		int const r = rgb[3 * i], g = rgb[3 * i + 1], b = rgb[3 * i + 2];
+		y[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+		cb[i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+		cr[i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+	}
+	return fputs("FRAME\n", output) != EOF && fwrite(planes, 3, pixels, output) == (size_t)pixels;
+}
+
+static int writing_stage(void* arg) {
+	struct pipeline* const p = arg;
+	struct animation const* const a = p->a;
+	int const pixels = a->width * a->height;
+
+	FILE* output = NULL;
+	uint8_t* planes = NULL;
+	if (a->format == animation_y4m) {
+		output = strcmp(a->output, "-") ? fopen(a->output, "wb") : stdout;
+		planes = malloc(3 * (size_t)pixels);
+		if (!output || !planes) {
+			fprintf(stderr, "ERROR: Cannot open %s for writing.\r\n", a->output);
+			fail(p);
+		}
+		else {
+			fprintf(output, "YUV4MPEG2 W%d H%d F25:1 Ip A1:1 C444\n", a->width, a->height);
+		}
+	}
+
+	for (int frame = 0; frame < a->frames && wait_for(p, frame, slot_colored); ++frame) {
+		double const start = now();
+		uint8_t const* const rgb = p->slots[frame % slot_count].rgb;
+		bool const ok = a->format == animation_y4m ? write_y4m_frame(output, pixels, rgb, planes)
+			: write_ppm(a, frame, rgb);
+		p->busy[2] += now() - start;
+		if (!ok) {
+			fprintf(stderr, "ERROR: Cannot write frame %d.\r\n", frame);
+			fail(p);
+			break;
+		}
+		pass_on(p, frame, slot_free);
+	}
+
+	if (output && output != stdout && fclose(output)) {
+		fail(p);
+	}
+	else if (output == stdout) {
+		fflush(stdout);
+	}
+	free(planes);
+	return 0;
+}
+
+bool animation_render(struct animation const* a) {
+	if (a->width <= 0 || a->height <= 0 || a->frames <= 0 || a->precision < 1 || a->precision > UINT16_MAX) {
+		fprintf(stderr, "ERROR: Invalid animation parameters.\r\n");
+		return false;
+	}
+	if (a->format == animation_ppm && !valid_name_pattern(a->output)) {
+		fprintf(stderr, "ERROR: Names of PPM frames need exactly one integer conversion, e.g. frame%%05d.ppm.\r\n");
+		return false;
+	}
+	if (!palette_rebuild(a->precision)) {
+		return false;
+	}
+
+	struct pipeline p;
+	memset(&p, 0, sizeof p);
+	p.a = a;
+	size_t const pixels = (size_t)a->width * a->height;
+	bool allocated = true;
+	for (int i = 0; i < slot_count; ++i) {
+		p.slots[i].counts = malloc(sizeof(uint16_t) * pixels);
+		p.slots[i].rgb = malloc(3 * pixels);
+		allocated = allocated && p.slots[i].counts && p.slots[i].rgb;
+	}
+	bool const own_pool = a->threads > 1 && pool_size() == 0 && pool_start(a->threads);
+	mtx_init(&p.lock, mtx_plain);
+	cnd_init(&p.changed);
+
+	thrd_t coloring, writing;
+	bool const started = allocated
+		&& thrd_create(&coloring, &coloring_stage, &p) == thrd_success;
+	if (!started) {
+		fprintf(stderr, "ERROR: Cannot start the animation pipeline.\r\n");
+	}
+	else if (thrd_create(&writing, &writing_stage, &p) != thrd_success) {
+		fprintf(stderr, "ERROR: Cannot start the animation pipeline.\r\n");
+		fail(&p);
+		thrd_join(coloring, NULL);
+	}
+	else {
+		fprintf(stderr, "INFO: Rendering %d frames %dx%d using %d threads and %s kernel.\r\n", a->frames,
+			a->width, a->height, pool_size() > 1 ? pool_size() : 1, batch_kernel_name(batch_get_kernel()));
+		double const start = now();
+		for (int frame = 0; frame < a->frames && wait_for(&p, frame, slot_free); ++frame) {
+			double const begin = now();
+			compute_frame(&p, frame);
+			p.busy[0] += now() - begin;
+			pass_on(&p, frame, slot_computed);
+		}
+		thrd_join(coloring, NULL);
+		thrd_join(writing, NULL);
+		double const elapsed = now() - start;
+		if (!p.failed) {
+			fprintf(stderr, "INFO: Rendered %d frames in %.3f s (%.2f FPS).\r\n", a->frames, elapsed,
+				a->frames / elapsed);
+			fprintf(stderr, "INFO: Busy time of stages: computation %.3f s, coloring %.3f s, writing %.3f s.\r\n",
+				p.busy[0], p.busy[1], p.busy[2]);
+		}
+	}
+
+	if (own_pool) {
+		pool_stop();
+	}
+	mtx_destroy(&p.lock);
+	cnd_destroy(&p.changed);
+	for (int i = 0; i < slot_count; ++i) {
+		free(p.slots[i].counts);
+		free(p.slots[i].rgb);
+	}
+	palette_cleanup();
+	return started && !p.failed;
+}
@@ -0,0 +1,32 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <stdbool.h>
+#include "juliaset.h"
+
+//Container of rendered frames
+enum animation_format {
+	animation_y4m, //Single YUV4MPEG2 stream (4:4:4), readable by ffmpeg and most players
+	animation_ppm //One binary PPM file per frame
+};
+
+/* Headless render of an animation. The constant C and the viewport move linearly
+ from their 'from' to their 'to' values, frame 0 shows the former, the last frame the latter. */
+struct animation {
+	int width, height, precision, frames;
+	my_complex c_from, c_to;
+	my_complex top_left_from, bottom_right_from;
+	my_complex top_left_to, bottom_right_to;
+	enum animation_format format;
+	/* Path of the Y4M file ("-" for stdout) or printf pattern of PPM file names with exactly
+	 one integer conversion taking the frame number, e.g. "frame%05d.ppm". */
+	char const* output;
+	int threads; //Threads computing each frame
+};
+
+/* Render all frames without touching SDL. Frames are pipelined, so that frame N + 1 is being
+ computed while frame N is colored and frame N - 1 is written. Prints throughput to stderr.
+ Returns false if the output cannot be written. */
+bool animation_render(struct animation const* a);
+
+#endif
@@ -0,0 +1,286 @@
+/*
+* Micro-benchmarks of the Julia set kernels and the coloring path.
+* Build and run by 'make bench' in src/prgsem, results are printed as CSV.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "juliaset.h"
+#include "juliaset_batch.h"
+#include "palette.h"
+#include "fractal_drawer.h"
+
+//Fixed views all kernels are measured on, so that results are comparable across commits
+struct viewport {
+	char const* name;
+	my_complex top_left, bottom_right, c;
+	int precision;
+};
+
+/* Precisions of the deep and interior views are kept low enough for the whole suite
+ to finish within a minute or so in the unoptimised build 'make bench' uses. */
+static struct viewport const viewports[] = {
+	//Bounds and constant the program starts with
+	{ "default", { -1.6, 1.1 }, { 1.6, -1.1 }, { 0.0, 0.75 }, 40 },
+	//A spot of the boundary of the "rabbit" magnified 1e9 times, counts vary wildly
+	{ "deep", { 0.33939645995952 - 1e-9, 0.1 + 0.75e-9 }, { 0.33939645995952 + 1e-9, 0.1 - 0.75e-9 },
+		{ -0.123, 0.745 }, 500 },
+	//Interior of the "rabbit", every pixel runs up to the precision
+	{ "interior", { -0.1, 0.075 }, { 0.1, -0.075 }, { -0.123, 0.745 }, 250 },
+};
+enum { viewport_count = sizeof viewports / sizeof viewports[0] };
+
+//Size of all views, must be divisible into the chunks the drawer uses
+static int width = 160, height = 120, repetitions = 5;
+enum { chunk_cols = 20, chunk_rows = 10 };
+//Double-double kernels are an order of magnitude slower, they compute only every n-th row of the view
+enum { double_double_row_stride = 8 };
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int compare_doubles(void const* a, void const* b) {
+	double const x = *(double const*)a, y = *(double const*)b;
+	return (x > y) - (x < y);
+}
+
+static double median(double* values, int count) {
+	qsort(values, count, sizeof(double), &compare_doubles);
+	return count % 2 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+//Median absolute deviation from the median
+static double mad(double const* values, int count, double med) {
+	double deviations[count];
+	for (int i = 0; i < count; ++i) {
+		deviations[i] = fabs(values[i] - med);
+	}
+	return median(deviations, count);
+}
+
+//State shared by all benchmarked functions
+static struct {
+	struct viewport const* view;
+	double dx, dy;
+	int* iterations; //Counts of all pixels, filled by the benchmarked kernel
+	uint16_t* counts; //Reference counts of all pixels for the coloring benchmarks
+	uint8_t* rgb;
+	int row_stride; //Kernels compute only rows divisible by it
+} bench = { .row_stride = 1 };
+
+static my_complex pixel(int row, int col) {
+	my_complex const p = { bench.view->top_left.re + col * bench.dx, bench.view->top_left.im - row * bench.dy };
+	return p;
+}
+
+static void run_convergence_test() {
+	for (int row = 0; row < height; ++row) {
+		for (int col = 0; col < width; ++col) {
+			bench.iterations[row * width + col] = convergence_test(pixel(row, col), bench.view->c, bench.view->precision);
+		}
+	}
+}
+
+static void run_convergence_test_periodic() {
+	double const tolerance = periodicity_tolerance(bench.dx, bench.dy);
+	long saved = 0;
+	for (int row = 0; row < height; ++row) {
+		for (int col = 0; col < width; ++col) {
+			bench.iterations[row * width + col] = convergence_test_periodic(pixel(row, col), bench.view->c,
+				bench.view->precision, tolerance, &saved);
+		}
+	}
+}
+
+static void run_row_double() {
+	for (int row = 0; row < height; ++row) {
+		convergence_test_row(pixel(row, 0), bench.dx, 0, 1, width, bench.view->c, bench.view->precision, 0.0,
+			bench.iterations + row * width, NULL);
+	}
+}
+
+static void run_row_float() {
+	for (int row = 0; row < height; ++row) {
+		convergence_test_row_float(pixel(row, 0), bench.dx, 0, 1, width, bench.view->c, bench.view->precision, 0.0,
+			bench.iterations + row * width, NULL);
+	}
+}
+
+//Row starts are doubles, so the low parts of double-double starts are zero
+static void run_row_double_double() {
+	my_complex const zero = { 0.0, 0.0 };
+	for (int row = 0; row < height; row += bench.row_stride) {
+		convergence_test_row_dd(pixel(row, 0), zero, bench.dx, 0, 1, width, bench.view->c, bench.view->precision,
+			bench.iterations + row * width);
+	}
+}
+
+static void run_color_components() {
+	int const max = bench.view->precision;
+	for (int i = 0; i < width * height; ++i) {
+		bench.rgb[3 * i] = red_component(bench.counts[i], max);
+		bench.rgb[3 * i + 1] = green_component(bench.counts[i], max);
+		bench.rgb[3 * i + 2] = blue_component(bench.counts[i], max);
+	}
+}
+
+static void run_palette_color_counts() {
+	palette_color_counts(bench.counts, width * height, bench.rgb);
+}
+
+//Feeds counts of the first chunk to the drawer the way data from Nucleo arrive
+static msg_compute drawer_chunk;
+
+static void run_fractal_add_point() {
+	for (int row = 0; row < drawer_chunk.n_im; ++row) {
+		for (int col = 0; col < drawer_chunk.n_re; ++col) {
+			fractal_add_point(drawer_chunk.cid, col, row, bench.counts[row * width + col]);
+		}
+	}
+}
+
+//Sum of reference counts of the rows computed by kernels
+static long sampled_iterations() {
+	long total = 0;
+	for (int row = 0; row < height; row += bench.row_stride) {
+		for (int col = 0; col < width; ++col) {
+			total += bench.counts[row * width + col];
+		}
+	}
+	return total;
+}
+
+/* Runs 'run' once to warm up and then 'repetitions' times, prints a CSV line.
+ 'pixels' is the number of pixels processed by a single run. Iterations per second
+ are reported only by kernels, which iterate all pixels of the rows they compute. */
+static void measure(char const* benchmark, char const* variant, void (*run)(), long pixels) {
+	bool const iterates = !strcmp(benchmark, "kernel");
+	double ns_per_pixel[repetitions];
+	run();
+	for (int i = 0; i < repetitions; ++i) {
+		double const start = now();
+		run();
+		ns_per_pixel[i] = (now() - start) * 1e9 / pixels;
+	}
+	double const med = median(ns_per_pixel, repetitions);
+	double const iterations_per_pixel = (double)sampled_iterations() / pixels;
+	printf("%s,%s,%s,%d,%d,%ld,%d,%.3f,%.3f,%.0f,", benchmark, variant, bench.view->name, width, height,
+		pixels, repetitions, med, mad(ns_per_pixel, repetitions, med), 1e9 / med);
+	if (iterates) {
+		printf("%.0f", 1e9 / med * iterations_per_pixel);
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+//Checks results of a kernel against the reference, so that a broken kernel cannot look fast
+static void verify(char const* variant) {
+	long differing = 0;
+	for (int i = 0; i < width * height; ++i) {
+		differing += bench.iterations[i] != bench.counts[i];
+	}
+	if (differing) {
+		fprintf(stderr, "WARN: %s differs from convergence_test in %ld pixels of view %s.\n", variant, differing,
+			bench.view->name);
+	}
+}
+
+//Makes given view the current one and computes its reference counts by convergence_test
+static void select_viewport(struct viewport const* view) {
+	bench.view = view;
+	bench.dx = (view->bottom_right.re - view->top_left.re) / width;
+	bench.dy = (view->top_left.im - view->bottom_right.im) / height;
+	run_convergence_test();
+	for (int i = 0; i < width * height; ++i) {
+		bench.counts[i] = bench.iterations[i];
+	}
+}
+
+int main(int argc, char** argv) {
+	for (int option; (option = getopt(argc, argv, "s:r:")) != -1;) {
+		bool valid = true;
+		switch (option) {
+		case 's':
+			valid = sscanf(optarg, "%dx%d", &width, &height) == 2 && width > 0 && height > 0
+				&& width % chunk_cols == 0 && height % chunk_rows == 0;
+			break;
+		case 'r': valid = sscanf(optarg, "%d", &repetitions) == 1 && repetitions > 0; break;
+		default: valid = false; break;
+		}
+		if (!valid) {
+			fprintf(stderr, "Usage: %s [-s WIDTHxHEIGHT] [-r repetitions]\n"
+				"Width must be divisible by %d and height by %d.\n", argv[0], chunk_cols, chunk_rows);
+			return EXIT_FAILURE;
+		}
+	}
+
+	bench.iterations = malloc(sizeof(int) * width * height);
+	bench.counts = malloc(sizeof(uint16_t) * width * height);
+	bench.rgb = malloc(3 * width * height);
+	if (!bench.iterations || !bench.counts || !bench.rgb) {
+		fprintf(stderr, "ERROR: Cannot allocate buffers.\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("benchmark,variant,viewport,width,height,pixels,repetitions,median_ns_per_pixel,mad_ns_per_pixel,"
+		"pixels_per_s,iterations_per_s\n");
+
+	for (int v = 0; v < viewport_count; ++v) {
+		select_viewport(&viewports[v]);
+		long const pixels = (long)width * height;
+
+		measure("kernel", "convergence_test", &run_convergence_test, pixels);
+		measure("kernel", "convergence_test_periodic", &run_convergence_test_periodic, pixels);
+		for (enum batch_kernel k = kernel_scalar; k < kernel_count; ++k) {
+			if (!batch_set_kernel(k)) {
+				continue;
+			}
+			char variant[64];
+			sprintf(variant, "row_double_%s", batch_kernel_name(k));
+			measure("kernel", variant, &run_row_double, pixels);
+			verify(variant);
+			if (batch_float_sufficient(bench.dx) && batch_float_sufficient(bench.dy)) {
+				sprintf(variant, "row_float_%s", batch_kernel_name(k));
+				measure("kernel", variant, &run_row_float, pixels);
+			}
+			//Not verified, double-double resolves points convergence_test rounds together
+			sprintf(variant, "row_double_double_%s", batch_kernel_name(k));
+			bench.row_stride = double_double_row_stride;
+			measure("kernel", variant, &run_row_double_double,
+				(long)width * ((height + bench.row_stride - 1) / bench.row_stride));
+			bench.row_stride = 1;
+		}
+		batch_select_kernel();
+
+		palette_rebuild(bench.view->precision);
+		measure("color", "color_components", &run_color_components, pixels);
+		measure("color", "palette_color_counts", &run_palette_color_counts, pixels);
+		palette_cleanup();
+	}
+
+	//The drawer opens a window, keep it off screen
+	setenv("SDL_VIDEODRIVER", "dummy", false);
+	select_viewport(&viewports[0]);
+	fractal_initialize(width, height, bench.view->precision, chunk_cols, chunk_rows, bench.view->top_left,
+		bench.view->bottom_right, bench.view->c);
+	fractal_set_all_chunks_unseen();
+	if (fractal_get_next_chunk(&drawer_chunk)) {
+		measure("drawer", "fractal_add_point", &run_fractal_add_point, (long)drawer_chunk.n_re * drawer_chunk.n_im);
+	}
+	fractal_cleanup();
+
+	free(bench.iterations);
+	free(bench.counts);
+	free(bench.rgb);
+	return EXIT_SUCCESS;
+}
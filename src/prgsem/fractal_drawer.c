@@ -2,20 +2,78 @@
 #include "fractal_drawer.h"
 #include "xwin_sdl.h"
 #include "juliaset.h"
+#include "juliaset_batch.h"
+#include "palette.h"
+#include "render_pool.h"
+#include "tile_cache.h"
+#include "perturbation.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <SDL.h>
 #include <assert.h>
+#include <math.h>
+#include <threads.h>
+#include <time.h>
+#include <limits.h>
 
 int chunks_in_row = 10;
 int chunks_in_col = 10;
 
 enum selection_policy selection_policy = policy_random;
+enum render_mode render_mode = render_full;
+bool single_precision_allowed = true;
+bool periodicity_check = false;
+bool symmetry_enabled = true;
+/* Export quality of save_to_ppm. Pixels whose count differs from a neighbour by more than
+ 'threshold' are supersampled by grid x grid samples, grid 1 turns it off. */
+struct {
+	int grid;
+	int threshold;
+} supersampling = { 1, 2 };
+//Choose precision by a preview pass before each local computation (see fractal_adapt_precision)
+bool auto_precision = false;
+//Number of threads used by local computation. One means computing on the calling thread.
+int render_threads = 1;
+//Interactive frame time in seconds, zero turns dynamic resolution off (see fractal_set_frame_budget)
+double frame_budget = 0.0;
 
-int buffer_size = 0;
+//Counters of work done by local computation
+struct render_stats {
+	long saved_iterations; //skipped thanks to periodicity checking
+	long pixels_computed; //evaluated by some kernel
+	long pixels_filled; //filled by subdivision without evaluation
+	long pixels_mirrored; //copied from their counterparts under z -> -z
+	long pixels_reused; //kept from the previous picture (e.g. shifted when panning)
+	long pixels_resumed; //iterated further from the orbit stored at the former precision
+	long pixels_cached; //copied from the tile cache
+	long orbits_rebased; //glitches corrected by perturbation (see perturbation.h)
+	long chunks_abandoned; //left unfinished by renders of views changed in the meantime
+} last_render, total_render;
+
+size_t buffer_size = 0;
+/* RGB colors of all pixels. Pixels of each chunk are stored contiguously row by row (a tile),
+ tiles follow each other along the Z-order curve over the chunk grid (see frame_pixel).
+ Row-major images are produced by detile for presentation and export only. Workers of local
+ computation write it while fractal_redraw shows it, see there. */
 uint8_t* frame_buffer = NULL;
+//Row-major copy of frame_buffer last shown by fractal_redraw
+uint8_t* display_buffer = NULL;
+//Tile of each chunk within frame_buffer and the chunk stored in each tile (chunk_count of both)
+static int* chunk_tiles = NULL, * tile_chunks = NULL;
+//Iteration count of each pixel in the tiles of frame_buffer, which is derived from it by the palette
+uint16_t* iteration_buffer = NULL;
+/* Pair of floats per pixel in the tiles of frame_buffer, z examined at the last step by pixels
+ which did not escape within 'precision' steps (see convergence_resume). NaN if unknown or
+ if the pixel escaped. */
+float* orbit_buffer = NULL;
+//Former precision, whose pixels are resumed by the next local computation (zero if none)
+static int resume_from = 0;
+//Some pixels of the picture (or of those it reuses) were computed by the Nucleo, they are not cached
+static bool remote_counts = false;
+/* Finished chunks. Writes by local computation are guarded by jobs.lock, so that the main thread
+ may count remaining chunks (see fractal_remaining_chunks) while workers finish them. */
 bool* chunks_done = NULL;
 int width = 0, height = 0;
 int precision = 0;
@@ -25,11 +83,100 @@ my_complex top_left = { 0.0,0.0 }, bot_right = { 0.0,0.0 };
 
 my_complex constant = { 0.0, 0.0 };
 
+//Bytes of iteration counts kept by the tile cache
+static size_t const tile_cache_capacity = 64 << 20;
+
+/* Automatic precision. Preview samples lie every 'stride' pixels in both directions. The chosen
+ precision is the lowest one, above which at most 'threshold' of samples still escape. */
+static struct {
+	int stride;
+	double threshold;
+	int minimum, limit; //Bounds of the chosen precision for local computation
+} const auto_precision_config = { 8, 0.002, 16, 4096 };
+
+//Size of blocks painted by the first pass of progressive rendering, each further pass halves it
+static int const progressive_block = 4;
+//Largest blocks the first pass may paint to fit the frame budget
+static int const max_preview_block = 32;
+/* Wall-clock seconds spent by recent passes of local computation and pixels they computed.
+ Both halve with every pass, so that their ratio follows the cost of pixels of recent views. */
+static struct {
+	double seconds, pixels;
+} recent_cost;
+
+/* Pixels of the previous picture reused after zooming. Pixel [col, row] was resampled iff
+ both cols[col] and rows[row] hold its former coordinates, -1 marks lines of new samples. */
+static struct {
+	bool active;
+	int* cols;
+	int* rows;
+	//Copy of the previous picture taken by fractal_zoom, allocated by fractal_set_image_size
+	uint16_t* counts;
+	float* orbits;
+} resampled;
+
+/* View too deep for double precision bounds. Its center is kept in multiprecision together with
+ the spacing of pixels, top_left and bot_right only approximate it. Pixels are computed
+ in double-double, views too deep even for that are perturbed. */
+static struct {
+	bool active;
+	mp_complex center;
+	double dx, dy;
+	struct perturbation_reference reference;
+} deep;
+
+//Pixel grid of a view, i.e. its top left pixel and the spacing of pixels
+struct grid {
+	my_complex corner;
+	double dx, dy;
+};
+
+//A navigation step, either a pan by whole pixels or a zoom about the center of the view
+struct move {
+	int cols, rows;
+	double scale; //One for pans
+};
+
+/* Speculative prefetch (see fractal_set_prefetch). Pans move by 'pan' of the picture
+ side rounded to whole pixels, zooms scale by 'scale' or its inverse. */
+static struct {
+	bool enabled;
+	double pan, scale;
+	struct move last; //The last navigation step, prefetched first as it is likely to be repeated
+} prefetch;
+
+//Wakes the redrawing thread whenever a pass of local computation is complete
+static struct {
+	mtx_t lock;
+	cnd_t signal;
+	int count;
+} updates;
+
+/* Local computation runs as a background job on a thread of its own (see fractal_render_async).
+ Every change of the view bumps 'generation', jobs started for an older one abandon their
+ remaining chunks as soon as the chunks being computed are done. */
+static struct {
+	thrd_t thread;
+	mtx_t lock; //Protects all members below
+	cnd_t signal; //Broadcast whenever a job is requested or finishes
+	unsigned generation;
+	bool pending; //A job was requested, but has not started yet
+	bool running;
+	bool speculate; //The last job finished its view, its neighbours are to be prefetched
+	bool speculating; //Prefetching is in progress, it gives way to any real job
+	bool quit;
+} jobs;
+//Generation the current local computation started in
+static unsigned job_generation;
+//Set on the thread running local computation, which must not cancel itself when it changes the view
+static _Thread_local bool computing_locally;
+static int render_thread(void* arg);
+
 int chunk_row() { return current_chunk / chunks_in_row; }
 int chunk_col() { return current_chunk % chunks_in_row; }
 
-double pixel_width() { return (bot_right.re - top_left.re) / width; }
-double pixel_height() { return (top_left.im - bot_right.im) / height; }
+double pixel_width() { return deep.active ? deep.dx : (bot_right.re - top_left.re) / width; }
+double pixel_height() { return deep.active ? deep.dy : (top_left.im - bot_right.im) / height; }
 
 double chunk_width() { return width / chunks_in_row; }
 double chunk_height() { return height / chunks_in_col; }
@@ -38,49 +185,247 @@ int chunk_count() { return chunks_in_col * chunks_in_row; }
 
 void fractal_initialize(int w, int h, int pr, int columns, int rows,
 	my_complex upper_left, my_complex lower_right, my_complex c) {
+	mtx_init(&jobs.lock, mtx_plain);
+	cnd_init(&jobs.signal);
+	if (thrd_create(&jobs.thread, &render_thread, NULL) != thrd_success) {
+		fprintf(stderr, "ERROR: Cannot start the rendering thread.\r\n");
+		exit(EXIT_FAILURE);
+	}
 	xwin_init(w, h);
 	fractal_set_image_size(w, h);
 	fractal_set_screen_division(rows, columns);
 	fractal_set_edge(bound_topleft, upper_left);
 	fractal_set_edge(bound_botright, lower_right);
 	fractal_set_constant(c);
-	precision = pr;
+	fractal_set_precision(pr);
+	tile_cache_init(tile_cache_capacity);
+	mtx_init(&updates.lock, mtx_plain);
+	cnd_init(&updates.signal);
 }
 
 void fractal_cleanup() {
+	fractal_cancel_render();
+	mtx_lock(&jobs.lock);
+	jobs.quit = true;
+	cnd_broadcast(&jobs.signal);
+	mtx_unlock(&jobs.lock);
+	thrd_join(jobs.thread, NULL);
+	mtx_destroy(&jobs.lock);
+	cnd_destroy(&jobs.signal);
+	pool_stop();
+	mtx_destroy(&updates.lock);
+	cnd_destroy(&updates.signal);
 	free(frame_buffer);
+	free(display_buffer);
+	free(chunk_tiles);
+	free(iteration_buffer);
+	free(orbit_buffer);
 	free(chunks_done);
+	free(resampled.cols);
+	free(resampled.rows);
+	free(resampled.counts);
+	free(resampled.orbits);
+	palette_cleanup();
+	tile_cache_cleanup();
+	perturbation_free(&deep.reference);
 	xwin_close();
 }
 
 
 bool fractal_set_image_size(int w, int h) {
+	fractal_cancel_render();
 	if (h % chunks_in_col || w % chunks_in_row) {
 		fprintf(stderr, "ERROR: Cannot have window side size not divisible by number of chunks.\r\n");
 		return false;
 	}
-	int const new_size = sizeof(uint8_t) * h * w * 3;
+	//Pixels and their color components are indexed by int, larger images must be streamed (see stream_image.h)
+	if ((long)w * h > INT_MAX / 3) {
+		fprintf(stderr, "ERROR: Window of %dx%d pixels is too large.\r\n", w, h);
+		return false;
+	}
+	size_t const new_size = sizeof(uint8_t) * h * w * 3;
 	uint8_t* const new_buffer = malloc(new_size);
-	if (!new_buffer) {
-		fprintf(stderr, "ERROR: Cannot allocate %d bytes of new frame buffer.\r\n", new_size);
+	uint8_t* const new_display = malloc(new_size);
+	uint16_t* const new_iterations = malloc(sizeof(uint16_t) * h * w);
+	float* const new_orbits = malloc(2 * sizeof(float) * h * w);
+	int* const new_cols = malloc(sizeof(int) * w);
+	int* const new_rows = malloc(sizeof(int) * h);
+	uint16_t* const new_counts = malloc(sizeof(uint16_t) * h * w);
+	float* const new_previous_orbits = malloc(2 * sizeof(float) * h * w);
+	if (!new_buffer || !new_display || !new_iterations || !new_orbits
+		|| !new_cols || !new_rows || !new_counts || !new_previous_orbits) {
+		fprintf(stderr, "ERROR: Cannot allocate %zu bytes of new frame buffer.\r\n", new_size);
+		free(new_buffer);
+		free(new_display);
+		free(new_iterations);
+		free(new_orbits);
+		free(new_cols);
+		free(new_rows);
+		free(new_counts);
+		free(new_previous_orbits);
 		return false;
 	}
 	buffer_size = new_size;
+	if (deep.active) {
+		//Keep the extents of the view
+		deep.dx *= (double)width / w;
+		deep.dy *= (double)height / h;
+	}
 	width = w;
 	height = h;
 
 	SDL_SetWindowSize(win, width, height);
 
 	free(frame_buffer);
+	free(display_buffer);
+	free(iteration_buffer);
+	free(orbit_buffer);
 	frame_buffer = new_buffer;
+	display_buffer = new_display;
+	memset(display_buffer, 0, buffer_size);
+	iteration_buffer = new_iterations;
+	orbit_buffer = new_orbits;
+	free(resampled.cols);
+	free(resampled.rows);
+	free(resampled.counts);
+	free(resampled.orbits);
+	resampled.cols = new_cols;
+	resampled.rows = new_rows;
+	resampled.counts = new_counts;
+	resampled.orbits = new_previous_orbits;
+	resampled.active = false;
 	fractal_clear_buffer();
 	return true;
 }
 
+int fractal_get_width() {
+	return width;
+}
+
+int fractal_get_height() {
+	return height;
+}
+
+//Position of the chunk at [col, row] of the chunk grid along the Z-order curve (bits interleaved)
+static uint64_t morton_code(int chunk) {
+	uint32_t const col = chunk % chunks_in_row, row = chunk / chunks_in_row;
+	uint64_t code = 0;
+	for (int bit = 0; bit < 32; ++bit) {
+		code |= (uint64_t)(col >> bit & 1) << 2 * bit | (uint64_t)(row >> bit & 1) << (2 * bit + 1);
+	}
+	return code;
+}
+
+static int compare_morton_codes(void const* a, void const* b) {
+	uint64_t const x = morton_code(*(int const*)a), y = morton_code(*(int const*)b);
+	return (x > y) - (x < y);
+}
+
+//Assigns tiles of frame_buffer to chunks of the current grid, 'tables' hold 2 * chunk_count ints
+static void order_tiles(int* tables) {
+	int const count = chunk_count();
+	free(chunk_tiles);
+	chunk_tiles = tables;
+	tile_chunks = tables + count;
+	for (int chunk = 0; chunk < count; ++chunk) {
+		tile_chunks[chunk] = chunk;
+	}
+	qsort(tile_chunks, count, sizeof(int), &compare_morton_codes);
+	for (int tile = 0; tile < count; ++tile) {
+		chunk_tiles[tile_chunks[tile]] = tile;
+	}
+}
+
+//Position of the pixel with row-major index 'pixel' within the tiled buffers
+static size_t tiled_index(int pixel) {
+	int const w = chunk_width(), h = chunk_height();
+	int const row = pixel / width, col = pixel % width;
+	int const tile = chunk_tiles[row / h * chunks_in_row + col / w];
+	return (size_t)tile * w * h + row % h * w + col % w;
+}
+
+//Address of the color of the pixel with row-major index 'pixel' within the tiled frame_buffer
+static uint8_t* frame_pixel(int pixel) {
+	return frame_buffer + 3 * tiled_index(pixel);
+}
+
+//Address of the iteration count of the pixel with row-major index 'pixel'
+static uint16_t* pixel_count(int pixel) {
+	return iteration_buffer + tiled_index(pixel);
+}
+
+//Address of the orbit of the pixel with row-major index 'pixel'
+static float* pixel_orbit(int pixel) {
+	return orbit_buffer + 2 * tiled_index(pixel);
+}
+
+//Number of pixels among 'count' consecutive ones starting at index 'first', which lie in the same tile row
+static int tile_run(int first, int count) {
+	int const left = chunk_width() - first % width % (int)chunk_width();
+	return count < left ? count : left;
+}
+
+/* Copies colors, iteration counts and orbits of 'count' consecutive pixels of a row starting
+ at index 'first' from the row-major arrays to the tiled buffers ('store' set) or the other way round. */
+static void copy_pixels(int first, int count, uint8_t* rgb, uint16_t* counts, float* orbits, bool store) {
+	for (int run; count > 0; first += run, count -= run, rgb += 3 * run, counts += run, orbits += 2 * run) {
+		run = tile_run(first, count);
+		if (store) {
+			memcpy(frame_pixel(first), rgb, 3 * run);
+			memcpy(pixel_count(first), counts, sizeof(uint16_t) * run);
+			memcpy(pixel_orbit(first), orbits, 2 * sizeof(float) * run);
+		}
+		else {
+			memcpy(rgb, frame_pixel(first), 3 * run);
+			memcpy(counts, pixel_count(first), sizeof(uint16_t) * run);
+			memcpy(orbits, pixel_orbit(first), 2 * sizeof(float) * run);
+		}
+	}
+}
+
+/* Produces the row-major image from frame_buffer. Tiles are read in their order and each of
+ their rows is a single memcpy, which the C library vectorises. */
+static void detile(uint8_t* rgb) {
+	int const w = chunk_width(), h = chunk_height();
+	for (int tile = 0; tile < chunk_count(); ++tile) {
+		int const chunk = tile_chunks[tile];
+		uint8_t const* const from = frame_buffer + 3 * (size_t)tile * w * h;
+		uint8_t* const to = rgb + 3 * ((size_t)(chunk / chunks_in_row) * h * width + (chunk % chunks_in_row) * w);
+		for (int row = 0; row < h; ++row) {
+			memcpy(to + 3 * (size_t)row * width, from + 3 * row * w, 3 * w);
+		}
+	}
+}
+
 void fractal_write_pixel(int row, int col, int r, int g, int b) {
-	frame_buffer[3 * (row * width + col) + 0] = r;
-	frame_buffer[3 * (row * width + col) + 1] = g;
-	frame_buffer[3 * (row * width + col) + 2] = b;
+	uint8_t* const color = frame_pixel(row * width + col);
+	color[0] = r;
+	color[1] = g;
+	color[2] = b;
+}
+
+//Derives colors of 'count' consecutive pixels starting at index 'first' from their iteration counts
+static void color_pixels(int first, int count) {
+	for (int run; count > 0; first += run, count -= run) {
+		run = tile_run(first, count);
+		palette_color_counts(pixel_count(first), run, frame_pixel(first));
+	}
+}
+
+//Stores iteration counts of 'count' consecutive pixels starting at index 'first' and colors them
+static void write_pixels(int first, int count, int const* iterations) {
+	for (int run; count > 0; first += run, count -= run, iterations += run) {
+		run = tile_run(first, count);
+		uint16_t* const counts = pixel_count(first);
+		for (int i = 0; i < run; ++i) {
+			counts[i] = iterations[i];
+		}
+		palette_color_counts(counts, run, frame_pixel(first));
+	}
+}
+
+void fractal_recolor() {
+	color_pixels(0, width * height);
 }
 
 void fractal_add_point(int chunk, int relative_col, int relative_row, int iterations) {
@@ -89,13 +434,239 @@ void fractal_add_point(int chunk, int relative_col, int relative_row, int iterat
 	int const row = chunk_row() * chunk_height() + relative_row;
 	int const col = chunk_col() * chunk_width() + relative_col;
 
-	fractal_write_pixel(row, col, red_component(iterations, precision),
-		green_component(iterations, precision), blue_component(iterations, precision));
+	write_pixels(row * width + col, 1, &iterations);
+	float* const orbit = pixel_orbit(row * width + col);
+	orbit[0] = orbit[1] = NAN;
 }
 
-void fractal_finish_chunk() {
+//Colors a row of any chunk, not necessarily the current one
+static void write_chunk_row(int chunk, int relative_row, int const* iterations) {
+	int const row = (chunk / chunks_in_row) * chunk_height() + relative_row;
+	int const col = (chunk % chunks_in_row) * chunk_width();
+
+	write_pixels(row * width + col, chunk_width(), iterations);
+}
+
+void fractal_add_row(int chunk, int relative_row, int const* iterations) {
+	assert(current_chunk == chunk);
+	write_chunk_row(chunk, relative_row, iterations);
+}
+
+//Upper left corner of any chunk. Messages carry it rounded to floats, local computation uses this.
+static struct grid current_grid() {
+	struct grid const result = { top_left, pixel_width(), pixel_height() };
+	return result;
+}
+
+static my_complex grid_chunk_corner(struct grid const* g, int chunk) {
+	my_complex const result = {
+		g->corner.re + chunk_width() * (chunk % chunks_in_row) * g->dx,
+		g->corner.im - chunk_height() * (chunk / chunks_in_row) * g->dy
+	};
+	return result;
+}
+
+static my_complex chunk_corner(int chunk) {
+	struct grid const g = current_grid();
+	return grid_chunk_corner(&g, chunk);
+}
+
+//Describes any chunk, not necessarily the current one
+static msg_compute chunk_description(int chunk) {
+	my_complex const corner = chunk_corner(chunk);
+	msg_compute result;
+	result.cid = chunk;
+	result.n_re = width / chunks_in_row;
+	result.n_im = height / chunks_in_col;
+	result.re = corner.re;
+	result.im = corner.im;
+	return result;
+}
+
+//Float kernels have twice as many lanes, they are used on every grid shallow enough for them
+static bool grid_uses_float(struct grid const* g) {
+	return single_precision_allowed && batch_float_sufficient(g->dx) && batch_float_sufficient(g->dy);
+}
+
+//Tolerance of periodicity checking on the grid, zero if the check is disabled
+static double grid_tolerance(struct grid const* g) {
+	return periodicity_check ? periodicity_tolerance(g->dx, g->dy) : 0.0;
+}
+
+//Key of the chunk in the tile cache, made of exactly the values and kernel the chunk is computed by
+static struct tile_key grid_chunk_key(struct grid const* g, int chunk) {
+	my_complex const corner = grid_chunk_corner(g, chunk);
+	return tile_key_make(corner.re, corner.im, g->dx, g->dy, constant.re, constant.im, grid_tolerance(g),
+		grid_uses_float(g) ? TILE_FLOAT_KERNEL : 0, precision, chunk_width(), chunk_height());
+}
+
+static struct tile_key chunk_key(int chunk) {
+	struct grid const g = current_grid();
+	return grid_chunk_key(&g, chunk);
+}
+
+//Fills the chunk by counts from the tile cache. Returns false on a miss.
+static bool load_cached_chunk(int chunk, struct render_stats* stats) {
+	if (deep.active) {
+		return false; //Keys hold corners in double precision
+	}
+	int const w = chunk_width(), h = chunk_height();
+	struct tile_key const key = chunk_key(chunk);
+	uint16_t counts[w * h];
+	if (!tile_cache_lookup(&key, counts)) {
+		return false;
+	}
+	//The tile of the chunk holds its pixels in the order of the cached counts
+	int const first_pixel = (chunk / chunks_in_row) * h * width + (chunk % chunks_in_row) * w;
+	memcpy(pixel_count(first_pixel), counts, sizeof(counts));
+	palette_color_counts(pixel_count(first_pixel), w * h, frame_pixel(first_pixel));
+	float* const orbits = pixel_orbit(first_pixel);
+	for (int i = 0; i < 2 * w * h; ++i) {
+		orbits[i] = NAN; //Orbits are not cached
+	}
+	stats->pixels_cached += w * h;
+	return true;
+}
+
+/* Stores counts of a finished chunk to the tile cache. Only counts computed locally by the kernel
+ of the key are cached. Subdivision fills pixels approximately, resumed orbits were rounded
+ to floats and the Nucleo iterates in single precision up to 255 steps. Deep views have no keys. */
+static void store_chunk(int chunk) {
+	if (deep.active || render_mode == render_subdivide || resume_from || remote_counts) {
+		return;
+	}
+	int const w = chunk_width(), h = chunk_height();
+	struct tile_key const key = chunk_key(chunk);
+	uint16_t counts[w * h];
+	int const first_pixel = (chunk / chunks_in_row) * h * width + (chunk % chunks_in_row) * w;
+	memcpy(counts, pixel_count(first_pixel), sizeof(counts));
+	tile_cache_store(&key, counts);
+}
+
+/* Julia sets are symmetric under z -> -z, thus pixel [col, row] has the same value as pixel
+ [col_sum - col, row_sum - row], provided the pixel grid is symmetric about zero, i.e. both sums
+ are integers. Returns false if they are not (or if exploiting symmetry is disabled). */
+static bool grid_mirror(struct grid const* g, int* col_sum, int* row_sum) {
+	if (!symmetry_enabled || deep.active) {
+		return false;
+	}
+	double const cols = -2 * g->corner.re / g->dx;
+	double const rows = 2 * g->corner.im / g->dy;
+	//Mirrored pixel cannot be visible unless the sums are within [0, 2 * side)
+	if (cols < 0 || cols >= 2 * width || rows < 0 || rows >= 2 * height) {
+		return false;
+	}
+	if (fabs(cols - round(cols)) > 1e-6 || fabs(rows - round(rows)) > 1e-6) {
+		return false;
+	}
+	*col_sum = round(cols);
+	*row_sum = round(rows);
+	return true;
+}
+
+static bool view_mirror(int* col_sum, int* row_sum) {
+	struct grid const g = current_grid();
+	return grid_mirror(&g, col_sum, row_sum);
+}
+
+/* Returns true iff every pixel of the chunk mirrors a visible pixel from the upper half
+ of the symmetric region. Such chunks are never computed, but copied once all others are done. */
+static bool grid_chunk_is_mirrored(struct grid const* g, int chunk) {
+	int col_sum, row_sum;
+	if (!grid_mirror(g, &col_sum, &row_sum)) {
+		return false;
+	}
+	int const first_col = (chunk % chunks_in_row) * chunk_width();
+	int const first_row = (chunk / chunks_in_row) * chunk_height();
+	int const last_col = first_col + chunk_width() - 1;
+	int const last_row = first_row + chunk_height() - 1;
+
+	return 2 * first_row > row_sum && row_sum - last_row >= 0
+		&& col_sum - last_col >= 0 && col_sum - first_col < width;
+}
+
+static bool chunk_is_mirrored(int chunk) {
+	struct grid const g = current_grid();
+	return grid_chunk_is_mirrored(&g, chunk);
+}
+
+//Returns true iff neither local computation nor prefetch runs in the background
+static bool jobs_idle() {
+	mtx_lock(&jobs.lock);
+	bool const idle = !jobs.pending && !jobs.running && !jobs.speculating;
+	mtx_unlock(&jobs.lock);
+	return idle;
+}
+
+//Marks the chunk done on any thread, see chunks_done
+static void set_chunk_done(int chunk) {
+	mtx_lock(&jobs.lock);
+	chunks_done[chunk] = true;
+	mtx_unlock(&jobs.lock);
+}
+
+/* Copy pixels of all unfinished mirrored chunks from their counterparts and mark them done.
+ With 'preview' set, chunks are only copied (to show an intermediate pass), not finished. */
+static void fill_mirrored_chunks(bool preview) {
+	int col_sum, row_sum;
+	if (!view_mirror(&col_sum, &row_sum)) {
+		return;
+	}
+	for (int chunk = 0; chunk < chunk_count(); ++chunk) {
+		if (chunks_done[chunk] || !chunk_is_mirrored(chunk)) {
+			continue;
+		}
+		int const first_col = (chunk % chunks_in_row) * chunk_width();
+		int const first_row = (chunk / chunks_in_row) * chunk_height();
+		for (int row = first_row; row < first_row + chunk_height(); ++row) {
+			for (int col = first_col; col < first_col + chunk_width(); ++col) {
+				int const pixel = row * width + col, mirror = (row_sum - row) * width + col_sum - col;
+				*pixel_count(pixel) = *pixel_count(mirror);
+				memcpy(frame_pixel(pixel), frame_pixel(mirror), 3);
+				//Orbits of z and -z coincide from the first step on
+				float* const orbit = pixel_orbit(pixel), * const mirrored = pixel_orbit(mirror);
+				orbit[0] = precision > 1 ? mirrored[0] : NAN;
+				orbit[1] = precision > 1 ? mirrored[1] : NAN;
+			}
+		}
+		if (!preview) {
+			last_render.pixels_mirrored += chunk_width() * chunk_height();
+			set_chunk_done(chunk);
+			store_chunk(chunk);
+		}
+	}
+}
+
+//Returns true iff the chunk still has to be computed (i.e. it is neither done nor mirrored)
+static bool chunk_pending(int chunk) {
+	return !chunks_done[chunk] && !chunk_is_mirrored(chunk);
+}
+
+//Fills mirrored chunks once there is nothing left to compute
+static void fill_mirrored_if_complete() {
+	for (int chunk = 0; chunk < chunk_count(); ++chunk) {
+		if (chunk_pending(chunk)) {
+			return;
+		}
+	}
+	//Sources of all mirrored chunks are available now
+	fill_mirrored_chunks(false);
+}
+
+//Marks the current chunk done, its pixels must already be filled
+static void complete_current_chunk() {
 	assert(current_chunk >= 0 && current_chunk < chunk_count());
-	chunks_done[current_chunk] = true;
+	set_chunk_done(current_chunk);
+	fill_mirrored_if_complete();
+	if (fractal_finished()) {
+		resume_from = 0;
+	}
+}
+
+void fractal_finish_chunk() {
+	assert(jobs_idle());
+	remote_counts = true;
+	complete_current_chunk();
 }
 
 static int find_new_chunk() {
@@ -103,7 +674,7 @@ static int find_new_chunk() {
 
 	if (selection_policy == policy_sequential) {
 		for (int i = 0; i < count; ++i) {
-			if (!chunks_done[i]) {
+			if (chunk_pending(i)) {
 				return i;
 			}
 		}
@@ -111,41 +682,44 @@ static int find_new_chunk() {
 	}
 	int const middle = rand() % count;
 	for (int chunk = middle; chunk < count; ++chunk) {
-		if (!chunks_done[chunk]) {
+		if (chunk_pending(chunk)) {
 			return chunk;
 		}
 	}
 	for (int chunk = middle - 1; chunk >= 0; --chunk) {
-		if (!chunks_done[chunk]) {
+		if (chunk_pending(chunk)) {
 			return chunk;
 		}
 	}
 	assert(false);
 }
 
-msg_compute fractal_get_next_chunk() {
-
-	assert(!fractal_finished());
-
-	msg_compute result;
-	current_chunk = find_new_chunk();
-	assert(current_chunk != -1);
-	result.cid = current_chunk;
-	result.n_re = width / chunks_in_row;
-	result.n_im = height / chunks_in_col;
-	result.re = top_left.re + chunk_width() * chunk_col() * pixel_width();
-	result.im = top_left.im - chunk_height() * chunk_row() * pixel_height();
-
-	return result;
+bool fractal_get_next_chunk(msg_compute* chunk) {
+	assert(computing_locally || jobs_idle());
+	//Mirrored chunks are never handed out, they are copied once nothing else is pending
+	fill_mirrored_if_complete();
+	while (!fractal_finished()) {
+		current_chunk = find_new_chunk();
+		assert(current_chunk != -1);
+		if (!load_cached_chunk(current_chunk, &last_render)) {
+			*chunk = chunk_description(current_chunk);
+			return true;
+		}
+		complete_current_chunk();
+	}
+	return false;
 }
 msg_set_compute fractal_get_settings() {
 	msg_set_compute result;
 
+	//The message holds the precision in a single byte, callers must not send higher ones
+	assert(precision <= UINT8_MAX);
 	result.n = precision;
 	result.c_re = constant.re;
 	result.c_im = constant.im;
 	result.d_im = pixel_height();
 	result.d_re = pixel_width();
+	result.flags = periodicity_check ? SET_COMPUTE_PERIODICITY : 0;
 	return result;
 }
 
@@ -156,52 +730,1001 @@ bool fractal_finished() {
 }
 
 void fractal_clear_buffer() {
+	fractal_cancel_render();
 	memset(frame_buffer, 0, buffer_size);
+	memset(iteration_buffer, 0, sizeof(uint16_t) * width * height);
+	for (int i = 0; i < 2 * width * height; ++i) {
+		orbit_buffer[i] = NAN;
+	}
 }
 
 int fractal_remaining_chunks() {
 	int const max = chunk_count();
 	int count = 0;
+	mtx_lock(&jobs.lock);
 	for (int i = 0; i < max; ++i) {
 		if (!chunks_done[i]) {
 			++count;
 		}
 	}
+	mtx_unlock(&jobs.lock);
 	return count;
 }
 
+/* Chunks being computed are shown as far as workers got, their pixels are copied without
+ synchronisation and a pixel may be caught half written. Every finished pass notifies
+ the redrawing thread (see fractal_wait_for_update), so the redraw following it is exact. */
 void fractal_redraw() {
-	xwin_redraw(width, height, frame_buffer);
+	detile(display_buffer);
+	xwin_redraw(width, height, display_buffer);
 	xwin_poll_events();
 }
 
 void fractal_set_all_chunks_unseen() {
+	fractal_cancel_render();
 	memset(chunks_done, false, chunk_count());
+	resampled.active = false;
+	resume_from = 0;
+	remote_counts = false;
 }
 
-void fractal_compute_locally() {
-	while (!fractal_finished()) {
-		msg_compute data = fractal_get_next_chunk();
-		for (int row = 0; row < data.n_im; ++row) {
-			for (int col = 0; col < data.n_re; ++col) {
-				my_complex point;
-				point.re = data.re + col * pixel_width();
-				point.im = data.im - row * pixel_height();
-				fractal_add_point(data.cid, col, row, convergence_test(point, constant, precision));
+/* Returns true iff all pixels of the chunk, shifted by [cols, rows], were computed before the
+ shift, i.e. they lie within the picture and all chunks containing them are done. */
+static bool chunk_survives_pan(int chunk, int cols, int rows) {
+	int const w = chunk_width(), h = chunk_height();
+	int const first_col = (chunk % chunks_in_row) * w + cols;
+	int const first_row = (chunk / chunks_in_row) * h + rows;
+	if (first_col < 0 || first_col + w > width || first_row < 0 || first_row + h > height) {
+		return false;
+	}
+	for (int row = first_row / h; row <= (first_row + h - 1) / h; ++row) {
+		for (int col = first_col / w; col <= (first_col + w - 1) / w; ++col) {
+			if (!chunks_done[row * chunks_in_row + col]) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+//Derives the approximate bounds of the deep view from its center
+static void update_deep_bounds() {
+	my_complex const center = mp_complex_to(deep.center);
+	my_complex const half = { width / 2.0 * deep.dx, height / 2.0 * deep.dy };
+	top_left.re = center.re - half.re;
+	top_left.im = center.im + half.im;
+	bot_right.re = center.re + half.re;
+	bot_right.im = center.im - half.im;
+}
+
+void fractal_pan(int cols, int rows) {
+	fractal_cancel_render();
+	prefetch.last = (struct move){ cols, rows, 1.0 };
+	double const dx = cols * pixel_width(), dy = rows * pixel_height();
+	if (deep.active) {
+		deep.center.re = mp_add(deep.center.re, mp_from_double(dx));
+		deep.center.im = mp_sub(deep.center.im, mp_from_double(dy));
+		update_deep_bounds();
+	}
+	else {
+		top_left.re += dx;
+		top_left.im -= dy;
+		bot_right.re += dx;
+		bot_right.im -= dy;
+	}
+
+	resampled.active = false;
+	resume_from = 0;
+	if (abs(cols) >= width || abs(rows) >= height) {
+		fractal_set_all_chunks_unseen();
+		return;
+	}
+	bool survives[chunk_count()];
+	for (int chunk = 0; chunk < chunk_count(); ++chunk) {
+		survives[chunk] = chunk_survives_pan(chunk, cols, rows);
+	}
+
+	//Pixel [col, row] takes the value of [col + cols, row + rows]. Rows are processed in such
+	//order that no source is overwritten before it is read.
+	int const dst_col = cols < 0 ? -cols : 0, src_col = cols > 0 ? cols : 0;
+	int const bytes = 3 * (width - abs(cols));
+	int const first = rows > 0 ? 0 : height - 1, last = rows > 0 ? height - rows : -rows - 1;
+	//Rows of the tiled buffers are not contiguous, they are moved through these
+	uint8_t colors[bytes];
+	uint16_t counts[bytes / 3];
+	float orbits[2 * bytes / 3];
+	for (int row = first; row != last; row += rows > 0 ? 1 : -1) {
+		copy_pixels((row + rows) * width + src_col, bytes / 3, colors, counts, orbits, false);
+		copy_pixels(row * width + dst_col, bytes / 3, colors, counts, orbits, true);
+	}
+
+	memcpy(chunks_done, survives, chunk_count());
+	//Mirrors of surviving chunks may become visible even if nothing else has to be computed
+	fill_mirrored_if_complete();
+}
+
+/* For each of 'count' new pixels along an axis finds the former pixel at the same point
+ of the complex plane. New pixel i lies at 'offset' + i * 'scale' in units of former pixels.
+ Returns the number of pixels found. */
+static int resample_axis(int* former, int count, double offset, double scale) {
+	int found = 0;
+	for (int i = 0; i < count; ++i) {
+		double const position = offset + i * scale;
+		long const nearest = lround(position);
+		bool const coincides = fabs(position - nearest) < 1e-6 && nearest >= 0 && nearest < count;
+		former[i] = coincides ? nearest : -1;
+		found += coincides;
+	}
+	return found;
+}
+
+/* Scales the deep view about its center, enters it if the view is about to become too deep
+ for double precision and leaves it once the view is shallow enough again. */
+static void zoom_deep(double scale) {
+	if (!deep.active) {
+		deep.center = mp_complex_from(fractal_get_center());
+		deep.dx = pixel_width();
+		deep.dy = pixel_height();
+		deep.active = true;
+		fprintf(stderr, "INFO: Entering deep zoom, pixels are computed in double-double precision.\r\n");
+	}
+	deep.dx *= scale;
+	deep.dy *= scale;
+	update_deep_bounds();
+	if (batch_double_sufficient(deep.dx) && batch_double_sufficient(deep.dy)) {
+		deep.active = false;
+		perturbation_free(&deep.reference);
+		fprintf(stderr, "INFO: Leaving deep zoom.\r\n");
+	}
+}
+
+double fractal_zoom(double scale) {
+	fractal_cancel_render();
+	if (pixel_width() * scale < MP_MIN_SPACING || pixel_height() * scale < MP_MIN_SPACING) {
+		fprintf(stderr, "ERROR: Cannot zoom in any further, multiprecision would not resolve the pixels.\r\n");
+		return 1.0;
+	}
+	prefetch.last = (struct move){ 0, 0, scale };
+	my_complex const middle = fractal_get_center();
+	my_complex const new_top_left = add(scalar_mul(sub(top_left, middle), scale), middle);
+	my_complex const new_bot_right = add(scalar_mul(sub(bot_right, middle), scale), middle);
+	double const old_width = pixel_width(), old_height = pixel_height();
+	my_complex const old_top_left = top_left;
+
+	//Resampling requires the whole previous picture
+	bool const complete = fractal_finished();
+	fractal_set_all_chunks_unseen();
+	bool const deep_zoom = deep.active
+		|| !batch_double_sufficient(old_width * scale) || !batch_double_sufficient(old_height * scale);
+	if (deep_zoom) {
+		zoom_deep(scale);
+	}
+	else {
+		top_left = new_top_left;
+		bot_right = new_bot_right;
+	}
+
+	if (!complete) {
+		return 0.0;
+	}
+	uint16_t* const previous = resampled.counts;
+	float* const previous_orbits = resampled.orbits;
+
+	//Bounds of deep views are too coarse to tell where the new pixels are, but the center stays put
+	int const found_cols = resample_axis(resampled.cols, width, deep_zoom ? width / 2.0 * (1 - scale)
+		: (top_left.re - old_top_left.re) / old_width, pixel_width() / old_width);
+	int const found_rows = resample_axis(resampled.rows, height, deep_zoom ? height / 2.0 * (1 - scale)
+		: (old_top_left.im - top_left.im) / old_height, pixel_height() / old_height);
+
+	memcpy(previous, iteration_buffer, sizeof(uint16_t) * width * height);
+	memcpy(previous_orbits, orbit_buffer, 2 * sizeof(float) * width * height);
+	for (int row = 0; row < height; ++row) {
+		if (resampled.rows[row] == -1) {
+			continue;
+		}
+		for (int col = 0; col < width; ++col) {
+			if (resampled.cols[col] != -1) {
+				int const pixel = row * width + col;
+				size_t const former = tiled_index(resampled.rows[row] * width + resampled.cols[col]);
+				*pixel_count(pixel) = previous[former];
+				memcpy(pixel_orbit(pixel), previous_orbits + 2 * former, 2 * sizeof(float));
+				color_pixels(pixel, 1);
 			}
 		}
-		fractal_finish_chunk();
 	}
+	resampled.active = true;
 
+	//Chunks consisting of resampled pixels only are done already
+	for (int chunk = 0; chunk < chunk_count(); ++chunk) {
+		int const first_col = (chunk % chunks_in_row) * chunk_width();
+		int const first_row = (chunk / chunks_in_row) * chunk_height();
+		bool covered = true;
+		for (int col = first_col; col < first_col + chunk_width() && covered; ++col) {
+			covered = resampled.cols[col] != -1;
+		}
+		for (int row = first_row; row < first_row + chunk_height() && covered; ++row) {
+			covered = resampled.rows[row] != -1;
+		}
+		chunks_done[chunk] = covered;
+	}
+	fill_mirrored_if_complete();
+	return (double)found_cols * found_rows / ((double)width * height);
+}
+
+//Kernel configuration shared by all chunks of a single local computation
+static struct {
+	bool use_float;
+	bool use_double_double; //Deep views only, perturbation is used otherwise
+	double tolerance;
+} local_kernel;
+
+//Chunk being computed locally together with counters to be updated. Each thread has its own.
+struct chunk_job {
+	msg_compute data;
+	my_complex corner; //data.re and data.im in double precision
+	struct render_stats* stats;
+};
+
+static void add_stats(struct render_stats* to, struct render_stats const* from) {
+	to->saved_iterations += from->saved_iterations;
+	to->pixels_computed += from->pixels_computed;
+	to->pixels_filled += from->pixels_filled;
+	to->pixels_mirrored += from->pixels_mirrored;
+	to->pixels_reused += from->pixels_reused;
+	to->pixels_resumed += from->pixels_resumed;
+	to->pixels_cached += from->pixels_cached;
+	to->orbits_rebased += from->orbits_rebased;
+	to->chunks_abandoned += from->chunks_abandoned;
+}
+
+/* Computes iterations of 'count' points of the deep view lying in a row. k-th of them lies
+ at offset + (first + k * stride) * step from the center of the view, where the reference orbit
+ starts. Returns the number of orbits rebased by perturbation. */
+static long compute_deep_samples(my_complex offset, double step, int first, int stride, int count,
+	int max_steps, int* iterations) {
+	if (local_kernel.use_double_double) {
+		my_complex hi, lo;
+		mp_to_double_double(mp_add(deep.center.re, mp_from_double(offset.re)), &hi.re, &lo.re);
+		mp_to_double_double(mp_add(deep.center.im, mp_from_double(offset.im)), &hi.im, &lo.im);
+		convergence_test_row_dd(hi, lo, step, first, stride, count, constant, max_steps, iterations);
+		return 0;
+	}
+	return perturbation_test_row(&deep.reference, offset, step, first, stride, count, max_steps, iterations);
+}
+
+/* Computes iterations of 'count' pixels of the chunk in given row. k-th of them lies
+ in column first + k * stride. Their orbits are stored to orbit_buffer. */
+static void compute_samples(struct chunk_job const* job, int row, int first, int stride, int count,
+	int* iterations) {
+	if (count == 0) {
+		return;
+	}
+	my_complex const start = { job->corner.re, job->corner.im - row * pixel_height() };
+	float orbits[2 * count];
+	for (int i = 0; i < 2 * count; ++i) {
+		orbits[i] = NAN;
+	}
+	if (deep.active) {
+		int const first_col = (job->data.cid % chunks_in_row) * job->data.n_re;
+		int const image_row = (job->data.cid / chunks_in_row) * job->data.n_im + row;
+		my_complex const offset = { -width / 2.0 * deep.dx, (height / 2.0 - image_row) * deep.dy };
+		job->stats->orbits_rebased += compute_deep_samples(offset, deep.dx, first_col + first, stride, count,
+			precision, iterations);
+	}
+	else if (local_kernel.use_float) {
+		job->stats->saved_iterations += convergence_test_row_float(start, pixel_width(), first, stride,
+			count, constant, precision, local_kernel.tolerance, iterations, orbits);
+	}
+	else {
+		job->stats->saved_iterations += convergence_test_row(start, pixel_width(), first, stride,
+			count, constant, precision, local_kernel.tolerance, iterations, orbits);
+	}
+	job->stats->pixels_computed += count;
+
+	int const first_pixel = ((job->data.cid / chunks_in_row) * job->data.n_im + row) * width
+		+ (job->data.cid % chunks_in_row) * job->data.n_re + first;
+	for (int k = 0; k < count; ++k) {
+		memcpy(pixel_orbit(first_pixel + k * stride), orbits + 2 * k, 2 * sizeof(float));
+	}
+}
+
+/* Computes iterations of 'count' pixels of the chunk starting at [first, row]. */
+static void compute_segment(struct chunk_job const* job, int row, int first, int count, int* iterations) {
+	compute_samples(job, row, first, 1, count, iterations);
+}
+
+/* Mariani-Silver subdivision of the rectangle [x0, x1] x [y0, y1] (inclusive) within a chunk
+ with iterations stored row by row in 'it'. Border of the rectangle must already be known.
+ If the whole border has the same count, the interior is filled by it. Otherwise the rectangle
+ is split in halves along its longer side, the dividing line is computed and both halves recurse. */
+static void subdivide(struct chunk_job const* job, int* it, int x0, int y0, int x1, int y1) {
+	int const stride = job->data.n_re;
+	if (x1 - x0 < 2 || y1 - y0 < 2) {
+		return; //No interior
+	}
+
+	int const value = it[y0 * stride + x0];
+	bool uniform = true;
+	for (int x = x0; x <= x1 && uniform; ++x) {
+		uniform = it[y0 * stride + x] == value && it[y1 * stride + x] == value;
+	}
+	for (int y = y0 + 1; y < y1 && uniform; ++y) {
+		uniform = it[y * stride + x0] == value && it[y * stride + x1] == value;
+	}
+
+	if (uniform) {
+		for (int y = y0 + 1; y < y1; ++y) {
+			for (int x = x0 + 1; x < x1; ++x) {
+				it[y * stride + x] = value;
+			}
+		}
+		job->stats->pixels_filled += (x1 - x0 - 1) * (y1 - y0 - 1);
+		return;
+	}
+
+	//Splitting tiny rectangles costs more than it can save
+	int const min_side = 4;
+	if (x1 - x0 <= min_side && y1 - y0 <= min_side) {
+		for (int y = y0 + 1; y < y1; ++y) {
+			compute_segment(job, y, x0 + 1, x1 - x0 - 1, &it[y * stride + x0 + 1]);
+		}
+		return;
+	}
+
+	if (x1 - x0 >= y1 - y0) {
+		int const middle = (x0 + x1) / 2;
+		for (int y = y0 + 1; y < y1; ++y) {
+			compute_segment(job, y, middle, 1, &it[y * stride + middle]);
+		}
+		subdivide(job, it, x0, y0, middle, y1);
+		subdivide(job, it, middle, y0, x1, y1);
+	}
+	else {
+		int const middle = (y0 + y1) / 2;
+		compute_segment(job, middle, x0 + 1, x1 - x0 - 1, &it[middle * stride + x0 + 1]);
+		subdivide(job, it, x0, y0, x1, middle);
+		subdivide(job, it, x0, middle, x1, y1);
+	}
+}
+
+/* Fills iterations of all pixels in the chunk using the Mariani-Silver algorithm. */
+static void compute_chunk_subdivided(struct chunk_job const* job, int* it) {
+	int const w = job->data.n_re, h = job->data.n_im;
+	compute_segment(job, 0, 0, w, it);
+	if (h > 1) {
+		compute_segment(job, h - 1, 0, w, &it[(h - 1) * w]);
+	}
+	for (int y = 1; y < h - 1; ++y) {
+		compute_segment(job, y, 0, 1, &it[y * w]);
+		if (w > 1) {
+			compute_segment(job, y, w - 1, 1, &it[y * w + w - 1]);
+		}
+	}
+	subdivide(job, it, 0, 0, w - 1, h - 1);
+}
+
+/* Computes and colors pixels in a row of the chunk, which were not resampled from the previous
+ picture. Resampled pixels are left untouched in the frame buffer. */
+static void compute_row_resampled(struct chunk_job const* job, int row, int* iterations) {
+	int const w = job->data.n_re;
+	int const first_col = (job->data.cid % chunks_in_row) * w;
+	int const first_row = (job->data.cid / chunks_in_row) * job->data.n_im;
+	int const pixels = (first_row + row) * width + first_col;
+	for (int x = 0; x < w;) {
+		if (resampled.cols[first_col + x] != -1) {
+			++job->stats->pixels_reused;
+			++x;
+			continue;
+		}
+		int end = x + 1;
+		while (end < w && resampled.cols[first_col + end] == -1) {
+			++end;
+		}
+		compute_segment(job, row, x, end - x, iterations);
+		write_pixels(pixels + x, end - x, iterations);
+		x = end;
+	}
+}
+
+/* Continues iterating pixels of the chunk which reached the former precision 'resume_from'.
+ Those without a stored orbit are computed from scratch, all other pixels are left untouched.
+ Orbits of resumed pixels are packed together, so that the kernel can process them in vectors. */
+static void resume_chunk(struct chunk_job const* job) {
+	int const w = job->data.n_re, h = job->data.n_im;
+	int const first_col = (job->data.cid % chunks_in_row) * w;
+	int const first_row = (job->data.cid / chunks_in_row) * h;
+	int pixels[w * h], iterations[w * h];
+	float orbits[2 * w * h];
+	int count = 0;
+	for (int row = 0; row < h; ++row) {
+		for (int col = 0; col < w; ++col) {
+			int const pixel = (first_row + row) * width + first_col + col;
+			if (*pixel_count(pixel) != resume_from) {
+				++job->stats->pixels_reused;
+			}
+			else if (isnan(*pixel_orbit(pixel))) {
+				compute_segment(job, row, col, 1, &iterations[0]);
+				write_pixels(pixel, 1, &iterations[0]);
+			}
+			else {
+				memcpy(orbits + 2 * count, pixel_orbit(pixel), 2 * sizeof(float));
+				pixels[count++] = pixel;
+			}
+		}
+	}
+
+	job->stats->saved_iterations += convergence_resume_row(orbits, count, constant, resume_from, precision,
+		local_kernel.tolerance, iterations);
+	job->stats->pixels_resumed += count;
+	for (int k = 0; k < count; ++k) {
+		float* const orbit = pixel_orbit(pixels[k]);
+		if (iterations[k] < precision) {
+			orbit[0] = orbit[1] = NAN;
+		}
+		else {
+			memcpy(orbit, orbits + 2 * k, 2 * sizeof(float));
+		}
+		write_pixels(pixels[k], 1, &iterations[k]);
+	}
+}
+
+/* Computes all pixels of the chunk and writes them to the frame buffer. Touches only
+ the part of frame buffer belonging to the chunk, so distinct chunks may run in parallel. */
+static void compute_chunk(int chunk, struct render_stats* stats) {
+	struct chunk_job const job = { chunk_description(chunk), chunk_corner(chunk), stats };
+	int const w = job.data.n_re, h = job.data.n_im;
+	if (resume_from) {
+		resume_chunk(&job);
+		return;
+	}
+	int iterations[h * w];
+	if (render_mode == render_subdivide) {
+		//Pixels filled by subdivision have no orbit
+		float* const orbits = pixel_orbit((chunk / chunks_in_row) * h * width + (chunk % chunks_in_row) * w);
+		for (int i = 0; i < 2 * w * h; ++i) {
+			orbits[i] = NAN;
+		}
+		compute_chunk_subdivided(&job, iterations);
+		for (int row = 0; row < h; ++row) {
+			write_chunk_row(chunk, row, &iterations[row * w]);
+		}
+		return;
+	}
+	int const first_row = (chunk / chunks_in_row) * h;
+	for (int row = 0; row < h; ++row) {
+		if (resampled.active && resampled.rows[first_row + row] != -1) {
+			compute_row_resampled(&job, row, iterations);
+		}
+		else {
+			compute_segment(&job, row, 0, w, iterations);
+			write_chunk_row(chunk, row, iterations);
+		}
+	}
+}
+
+//Paints size x size block of the chunk (clipped by its border) by the color of given count
+static void paint_block(int chunk, int col, int row, int size, int iterations) {
+	int const w = chunk_width(), h = chunk_height();
+	int const first_col = (chunk % chunks_in_row) * w + col;
+	int const first_row = (chunk / chunks_in_row) * h + row;
+	int const cols = col + size <= w ? size : w - col;
+	int const rows = row + size <= h ? size : h - row;
+
+	for (int r = 0; r < rows; ++r) {
+		int const pixels = (first_row + r) * width + first_col;
+		uint16_t* const counts = pixel_count(pixels);
+		for (int c = 0; c < cols; ++c) {
+			counts[c] = iterations;
+		}
+		color_pixels(pixels, cols);
+	}
+}
+
+/* One pass of progressive rendering with samples 'size' pixels apart. Samples lying on the grid
+ of the previous (twice as coarse) pass are not computed again. Each new sample paints a block
+ of size x size pixels, so that the picture is complete after every pass. */
+static void compute_chunk_pass(int chunk, int size, bool first_pass, struct render_stats* stats) {
+	struct chunk_job const job = { chunk_description(chunk), chunk_corner(chunk), stats };
+	int const w = job.data.n_re, h = job.data.n_im;
+	int iterations[w];
+	for (int row = 0; row < h; row += size) {
+		bool const reused = !first_pass && row % (2 * size) == 0;
+		int const first = reused ? size : 0;
+		int const stride = reused ? 2 * size : size;
+		int const count = first < w ? (w - first + stride - 1) / stride : 0;
+
+		compute_samples(&job, row, first, stride, count, iterations);
+		for (int k = 0; k < count; ++k) {
+			paint_block(chunk, first + k * stride, row, size, iterations[k]);
+		}
+	}
+}
+
+//Argument shared by all chunk tasks of a single local computation
+struct chunk_tasks {
+	struct render_stats* stats; //One per worker
+	int first_block; //Block size of the first pass, halved by each further pass
+	int pass, passes; //Current pass of progressive rendering and their count
+};
+
+//Returns true iff the view changed since the current local computation started
+static bool job_cancelled() {
+	mtx_lock(&jobs.lock);
+	bool const cancelled = jobs.generation != job_generation;
+	mtx_unlock(&jobs.lock);
+	return cancelled;
+}
+
+//Task executed for each chunk (possibly by threads of the rendering pool)
+static void chunk_task(int chunk, int worker, void* arg) {
+	struct chunk_tasks const* const job = arg;
+	if (job_cancelled()) {
+		return;
+	}
+	if (job->passes > 1) {
+		compute_chunk_pass(chunk, job->first_block >> job->pass, job->pass == 0, &job->stats[worker]);
+	}
+	else {
+		compute_chunk(chunk, &job->stats[worker]);
+	}
+	if (job->pass + 1 == job->passes) {
+		store_chunk(chunk);
+		set_chunk_done(chunk);
+	}
+}
+
+static void notify_update() {
+	mtx_lock(&updates.lock);
+	++updates.count;
+	cnd_broadcast(&updates.signal);
+	mtx_unlock(&updates.lock);
+}
+
+void fractal_wait_for_update(int timeout_ms) {
+	static int seen = 0;
+	struct timespec deadline;
+	timespec_get(&deadline, TIME_UTC);
+	deadline.tv_nsec += timeout_ms % 1000 * 1000000L;
+	deadline.tv_sec += timeout_ms / 1000 + deadline.tv_nsec / 1000000000L;
+	deadline.tv_nsec %= 1000000000L;
+
+	mtx_lock(&updates.lock);
+	while (seen == updates.count) {
+		if (cnd_timedwait(&updates.signal, &updates.lock, &deadline) != thrd_success) {
+			break;
+		}
+	}
+	seen = updates.count;
+	mtx_unlock(&updates.lock);
+}
+
+/* Chooses kernels for the current view, which iterate up to 'max_steps'. Returns false
+ if the reference orbit of a deep view cannot be computed. */
+static bool select_local_kernel(int max_steps) {
+	struct grid const g = current_grid();
+	local_kernel.use_float = grid_uses_float(&g);
+	local_kernel.tolerance = grid_tolerance(&g);
+	//Double-double is vectorised like the double kernels, perturbation takes over once it runs out of bits
+	local_kernel.use_double_double = deep.active
+		&& batch_double_double_sufficient(pixel_width()) && batch_double_double_sufficient(pixel_height());
+	return !deep.active || local_kernel.use_double_double
+		|| perturbation_prepare(&deep.reference, deep.center, constant, max_steps);
+}
+
+//Number of preview samples with counts in [from, to)
+static long count_samples(long const* histogram, int from, int to) {
+	long result = 0;
+	for (int i = from; i < to; ++i) {
+		result += histogram[i];
+	}
+	return result;
+}
+
+int fractal_adapt_precision(int limit) {
+	fractal_cancel_render();
+	int const stride = auto_precision_config.stride;
+	int const cols = (width - stride / 2 + stride - 1) / stride, rows = (height - stride / 2 + stride - 1) / stride;
+	long* const histogram = calloc(limit + 1, sizeof(long));
+	if (!histogram || cols <= 0 || rows <= 0 || !select_local_kernel(limit)) {
+		free(histogram);
+		return precision;
+	}
+
+	//Preview samples are computed on the calling thread, they are a small fraction of the picture
+	int iterations[cols];
+	for (int row = stride / 2; row < height; row += stride) {
+		if (deep.active) {
+			my_complex const offset = { -width / 2.0 * deep.dx, (height / 2.0 - row) * deep.dy };
+			compute_deep_samples(offset, deep.dx, stride / 2, stride, cols, limit, iterations);
+		}
+		else {
+			my_complex const start = { top_left.re, top_left.im - row * pixel_height() };
+			(local_kernel.use_float ? &convergence_test_row_float : &convergence_test_row)(start, pixel_width(),
+				stride / 2, stride, cols, constant, limit, local_kernel.tolerance, iterations, NULL);
+		}
+		for (int k = 0; k < cols; ++k) {
+			++histogram[iterations[k]];
+		}
+	}
+
+	//Samples with counts in [n, limit) are drawn as not escaping at precision n, but escape at 'limit'
+	long const allowed = auto_precision_config.threshold * cols * rows;
+	int chosen = auto_precision_config.minimum < limit ? auto_precision_config.minimum : limit;
+	long changing = count_samples(histogram, chosen, limit);
+	while (changing > allowed) {
+		changing -= histogram[chosen++];
+	}
+	//Keep the current precision unless it is too low or needlessly high, so that the view does not flicker
+	bool const keep = precision <= limit && precision <= 2 * chosen
+		&& count_samples(histogram, precision, limit) <= allowed;
+	if (!keep && fractal_set_precision(chosen)) {
+		fprintf(stderr, "INFO: Automatic precision set to %d iterations (%.2f %% of preview samples escape later).\r\n",
+			chosen, 100.0 * changing / ((long)cols * rows));
+	}
+	free(histogram);
+	return precision;
+}
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+//Accounts a pass, which computed 'pixels' in 'seconds'
+static void record_cost(double seconds, long pixels) {
+	if (pixels > 0) {
+		recent_cost.seconds = recent_cost.seconds / 2 + seconds;
+		recent_cost.pixels = recent_cost.pixels / 2 + pixels;
+	}
+}
+
+//Recent wall-clock seconds per computed pixel, zero if unknown
+static double pixel_cost() {
+	return recent_cost.pixels > 0.0 ? recent_cost.seconds / recent_cost.pixels : 0.0;
+}
+
+static long pixels_computed(struct render_stats const* stats, int count) {
+	long result = 0;
+	for (int i = 0; i < count; ++i) {
+		result += stats[i].pixels_computed;
+	}
+	return result;
+}
+
+/* Block size of the first pass over 'count' chunks. Progressive rendering starts by
+ progressive_block, the frame budget makes blocks as large as needed to fit the recent cost
+ of pixels. Size one means a single pass, which computes chunks according to the render mode. */
+static int first_block_size(int count) {
+	if (resume_from) {
+		return 1; //Only pixels which reached the former limit are iterated further
+	}
+	int size = render_mode == render_progressive ? progressive_block : 1;
+	if (frame_budget > 0.0) {
+		double const pixels = (double)count * chunk_width() * chunk_height(), cost = pixel_cost();
+		while (size < max_preview_block && (cost == 0.0 || pixels / (size * size) * cost > frame_budget)) {
+			size *= 2;
+		}
+	}
+	return size;
+}
+
+//Waits until the view changes or the time elapses. Returns true iff the view changed.
+static bool wait_for_input(double seconds) {
+	struct timespec deadline;
+	timespec_get(&deadline, TIME_UTC);
+	long const nanoseconds = deadline.tv_nsec + (long)(seconds * 1e9);
+	deadline.tv_sec += nanoseconds / 1000000000L;
+	deadline.tv_nsec = nanoseconds % 1000000000L;
+	mtx_lock(&jobs.lock);
+	while (jobs.generation == job_generation) {
+		if (cnd_timedwait(&jobs.signal, &jobs.lock, &deadline) != thrd_success) {
+			break;
+		}
+	}
+	bool const changed = jobs.generation != job_generation;
+	mtx_unlock(&jobs.lock);
+	return changed;
+}
+
+//Computes all pending chunks unless the view changes in the meantime
+static void compute_locally() {
+	computing_locally = true;
+	if (auto_precision) {
+		fractal_adapt_precision(auto_precision_config.limit);
+	}
+	if (!select_local_kernel(precision)) {
+		computing_locally = false;
+		return;
+	}
+	memset(&last_render, 0, sizeof last_render);
+	for (int chunk = 0; chunk < chunk_count(); ++chunk) {
+		if (chunks_done[chunk]) {
+			last_render.pixels_reused += chunk_width() * chunk_height();
+		}
+	}
+
+	if (render_threads == 1 && render_mode != render_progressive && frame_budget == 0.0) {
+		//Reference implementation, chunks are computed one by one on the calling thread
+		double const start = now();
+		msg_compute data;
+		while (!job_cancelled() && fractal_get_next_chunk(&data)) {
+			compute_chunk(data.cid, &last_render);
+			store_chunk(data.cid);
+			complete_current_chunk();
+		}
+		record_cost(now() - start, last_render.pixels_computed);
+	}
+	else {
+		int tasks[chunk_count()];
+		int count = 0;
+		for (int chunk = 0; chunk < chunk_count(); ++chunk) {
+			if (!chunk_pending(chunk)) {
+				continue;
+			}
+			if (load_cached_chunk(chunk, &last_render)) {
+				set_chunk_done(chunk);
+			}
+			else {
+				tasks[count++] = chunk;
+			}
+		}
+		struct render_stats stats[render_threads];
+		memset(stats, 0, sizeof stats);
+		struct chunk_tasks job = { stats, first_block_size(count), 0, 1 };
+		while (job.first_block >> job.passes) {
+			++job.passes;
+		}
+
+		for (job.pass = 0; job.pass < job.passes && !job_cancelled(); ++job.pass) {
+			double const start = now();
+			long const computed = pixels_computed(stats, render_threads);
+			if (render_threads == 1) {
+				for (int i = 0; i < count; ++i) {
+					chunk_task(tasks[i], 0, &job);
+				}
+			}
+			else {
+				pool_run(tasks, count, &chunk_task, &job);
+			}
+			record_cost(now() - start, pixels_computed(stats, render_threads) - computed);
+			if (job.pass + 1 < job.passes) {
+				fill_mirrored_chunks(true);
+				notify_update();
+				//The coarse frame is shown, finer passes wait until the user stops moving
+				if (job.pass == 0 && frame_budget > 0.0) {
+					wait_for_input(frame_budget);
+				}
+			}
+		}
+
+		for (int i = 0; i < render_threads; ++i) {
+			add_stats(&last_render, &stats[i]);
+		}
+		if (!job_cancelled()) {
+			fill_mirrored_chunks(false);
+		}
+	}
+
+	if (job_cancelled()) {
+		//Chunks left are computed (or dropped) by the job of the new view
+		last_render.chunks_abandoned = fractal_remaining_chunks();
+	}
+	else {
+		resampled.active = false;
+		resume_from = 0;
+	}
+	add_stats(&total_render, &last_render);
+	computing_locally = false;
+	notify_update();
+}
+
+//Returns true iff real work was requested (or the view changed) since the last job started
+static bool speculation_preempted() {
+	mtx_lock(&jobs.lock);
+	bool const preempted = jobs.pending || jobs.generation != job_generation;
+	mtx_unlock(&jobs.lock);
+	return preempted;
+}
+
+//Computes the pixel grid of the view the move leads to. Returns false if it is a deep view.
+static bool grid_after(struct move m, struct grid* g) {
+	//Same expressions as fractal_pan and fractal_zoom use, so that the keys of chunks match
+	my_complex tl = top_left, br = bot_right;
+	if (m.scale == 1.0) {
+		double const dx = m.cols * pixel_width(), dy = m.rows * pixel_height();
+		tl.re += dx;
+		tl.im -= dy;
+		br.re += dx;
+		br.im -= dy;
+	}
+	else {
+		if (!batch_double_sufficient(pixel_width() * m.scale) || !batch_double_sufficient(pixel_height() * m.scale)) {
+			return false;
+		}
+		my_complex const middle = fractal_get_center();
+		tl = add(scalar_mul(sub(top_left, middle), m.scale), middle);
+		br = add(scalar_mul(sub(bot_right, middle), m.scale), middle);
+	}
+	g->corner = tl;
+	g->dx = (br.re - tl.re) / width;
+	g->dy = (tl.im - br.im) / height;
+	return true;
+}
+
+//Chunks of a view one move away, which are computed speculatively into the tile cache
+struct prefetch_job {
+	struct grid grid;
+	bool use_float;
+	double tolerance;
+};
+
+//Task computing a single chunk of the prefetched view (possibly by threads of the rendering pool)
+static void prefetch_chunk(int chunk, int worker, void* arg) {
+	struct prefetch_job const* const job = arg;
+	if (speculation_preempted()) {
+		return;
+	}
+	int const w = chunk_width(), h = chunk_height();
+	my_complex const corner = grid_chunk_corner(&job->grid, chunk);
+	int iterations[w];
+	uint16_t counts[w * h];
+	for (int row = 0; row < h; ++row) {
+		//Same points as compute_samples evaluates once the view is current
+		my_complex const start = { corner.re, corner.im - row * job->grid.dy };
+		(job->use_float ? &convergence_test_row_float : &convergence_test_row)(start, job->grid.dx, 0, 1, w,
+			constant, precision, job->tolerance, iterations, NULL);
+		for (int k = 0; k < w; ++k) {
+			counts[row * w + k] = iterations[k];
+		}
+	}
+	struct tile_key const key = grid_chunk_key(&job->grid, chunk);
+	tile_cache_prefetch(&key, counts);
+}
+
+/* Computes chunks, which any of the six moves would have to compute, starting by the last move.
+ Chunks kept by a pan, mirrored ones and those already cached are skipped. Stops once preempted. */
+static void prefetch_neighbours() {
+	if (deep.active) {
+		return; //Deep views are not cached
+	}
+	int const cols = lround(width * prefetch.pan), rows = lround(height * prefetch.pan);
+	struct move const moves[] = {
+		{ 0, 0, prefetch.scale }, { 0, 0, 1 / prefetch.scale },
+		{ -cols, 0, 1.0 }, { cols, 0, 1.0 }, { 0, -rows, 1.0 }, { 0, rows, 1.0 }
+	};
+	int const move_count = sizeof moves / sizeof moves[0];
+	int first = 0;
+	for (int i = 0; i < move_count; ++i) {
+		if (moves[i].cols == prefetch.last.cols && moves[i].rows == prefetch.last.rows
+			&& moves[i].scale == prefetch.last.scale) {
+			first = i;
+		}
+	}
+
+	for (int i = 0; i < move_count && !speculation_preempted(); ++i) {
+		struct move const m = moves[(first + i) % move_count];
+		struct prefetch_job job;
+		if (!grid_after(m, &job.grid)) {
+			continue;
+		}
+		job.use_float = grid_uses_float(&job.grid);
+		job.tolerance = grid_tolerance(&job.grid);
+
+		int tasks[chunk_count()];
+		int count = 0;
+		for (int chunk = 0; chunk < chunk_count(); ++chunk) {
+			struct tile_key const key = grid_chunk_key(&job.grid, chunk);
+			if ((m.scale == 1.0 && chunk_survives_pan(chunk, m.cols, m.rows))
+				|| grid_chunk_is_mirrored(&job.grid, chunk) || tile_cache_contains(&key)) {
+				continue;
+			}
+			tasks[count++] = chunk;
+		}
+		if (render_threads > 1) {
+			pool_run(tasks, count, &prefetch_chunk, &job);
+		}
+		else {
+			for (int k = 0; k < count; ++k) {
+				prefetch_chunk(tasks[k], 0, &job);
+			}
+		}
+	}
+}
+
+static int render_thread(void* arg) {
+	mtx_lock(&jobs.lock);
+	while (!jobs.quit) {
+		if (jobs.pending) {
+			jobs.pending = false;
+			jobs.running = true;
+			job_generation = jobs.generation;
+			mtx_unlock(&jobs.lock);
+
+			compute_locally();
+
+			mtx_lock(&jobs.lock);
+			jobs.running = false;
+			//Neighbours of the view are prefetched only if it was finished
+			jobs.speculate = prefetch.enabled && jobs.generation == job_generation;
+			cnd_broadcast(&jobs.signal);
+		}
+		else if (jobs.speculate) {
+			jobs.speculate = false;
+			jobs.speculating = true;
+			mtx_unlock(&jobs.lock);
+
+			prefetch_neighbours();
+
+			mtx_lock(&jobs.lock);
+			jobs.speculating = false;
+			cnd_broadcast(&jobs.signal);
+		}
+		else {
+			cnd_wait(&jobs.signal, &jobs.lock);
+		}
+	}
+	mtx_unlock(&jobs.lock);
+	return 0;
+}
+
+void fractal_render_async() {
+	mtx_lock(&jobs.lock);
+	jobs.pending = true;
+	cnd_broadcast(&jobs.signal);
+	mtx_unlock(&jobs.lock);
+}
+
+void fractal_cancel_render() {
+	if (computing_locally) {
+		return; //The computation changes its own view (e.g. by fractal_adapt_precision), it is not stale
+	}
+	mtx_lock(&jobs.lock);
+	++jobs.generation;
+	jobs.pending = false;
+	jobs.speculate = false;
+	cnd_broadcast(&jobs.signal); //Wakes jobs waiting for input
+	while (jobs.running || jobs.speculating) {
+		cnd_wait(&jobs.signal, &jobs.lock);
+	}
+	mtx_unlock(&jobs.lock);
+}
+
+bool fractal_rendering() {
+	mtx_lock(&jobs.lock);
+	bool const busy = jobs.pending || jobs.running;
+	mtx_unlock(&jobs.lock);
+	return busy;
+}
+
+//Blocks until the job in flight (if any) completes
+static void wait_for_render() {
+	mtx_lock(&jobs.lock);
+	while (jobs.pending || jobs.running) {
+		cnd_wait(&jobs.signal, &jobs.lock);
+	}
+	mtx_unlock(&jobs.lock);
+}
+
+void fractal_compute_locally() {
+	fractal_cancel_render();
+	mtx_lock(&jobs.lock);
+	job_generation = jobs.generation;
+	mtx_unlock(&jobs.lock);
+	compute_locally();
 }
 
 bool fractal_set_screen_division(int rows, int columns) {
+	fractal_cancel_render();
 	assert(rows > 0 && columns > 0);
 
 	int const new_size = sizeof(bool) * rows * columns;
 	bool* const new_buffer = malloc(new_size);
-	if (!new_buffer) {
+	int* const new_tiles = malloc(2 * sizeof(int) * rows * columns);
+	if (!new_buffer || !new_tiles) {
 		fprintf(stderr, "ERROR: Cannot allocate %d bytes for chunk manager.\r\n", new_size);
+		free(new_buffer);
+		free(new_tiles);
 		return false;
 	}
 	free(chunks_done);
@@ -210,15 +1733,177 @@ bool fractal_set_screen_division(int rows, int columns) {
 
 	chunks_in_col = rows;
 	chunks_in_row = columns;
+	//Tiles of the frame buffer follow the chunk grid
+	order_tiles(new_tiles);
 
 	return true;
 }
 
 void fractal_set_selection_policy(enum selection_policy p) {
+	fractal_cancel_render();
 	selection_policy = p;
 }
 
+void fractal_set_render_mode(enum render_mode m) {
+	fractal_cancel_render();
+	render_mode = m;
+}
+
+bool fractal_set_thread_count(int threads) {
+	fractal_cancel_render();
+	assert(threads > 0);
+	pool_stop();
+	if (threads > 1 && !pool_start(threads)) {
+		render_threads = 1;
+		return false;
+	}
+	render_threads = threads;
+	return true;
+}
+
+int fractal_get_thread_count() {
+	return render_threads;
+}
+
+void fractal_set_symmetry(bool enabled) {
+	fractal_cancel_render();
+	symmetry_enabled = enabled;
+	//Chunks left may all be mirrored now, nothing else would fill them
+	fill_mirrored_if_complete();
+}
+
+bool fractal_get_symmetry() {
+	return symmetry_enabled;
+}
+
+bool fractal_set_precision(int pr) {
+	fractal_cancel_render();
+	if (pr < 1 || pr > UINT16_MAX) {
+		fprintf(stderr, "ERROR: Precision must lie within [1, %d].\r\n", UINT16_MAX);
+		return false;
+	}
+	if (!palette_rebuild(pr)) {
+		return false;
+	}
+	if (pr > precision && !resume_from && precision && fractal_finished()) {
+		//Only pixels which reached the former limit might escape later, their orbits are resumed
+		resume_from = precision;
+		for (int chunk = 0; chunk < chunk_count(); ++chunk) {
+			int const first_pixel = (chunk / chunks_in_row) * chunk_height() * width
+				+ (chunk % chunks_in_row) * chunk_width();
+			for (int row = 0; row < chunk_height() && chunks_done[chunk]; ++row) {
+				for (int col = 0; col < chunk_width(); ++col) {
+					if (*pixel_count(first_pixel + row * width + col) == resume_from) {
+						chunks_done[chunk] = false;
+						break;
+					}
+				}
+			}
+		}
+	}
+	else if (pr > precision) {
+		/* Unfinished pictures are computed anew. So are those still being resumed, finished chunks
+		 may already hold counts of 'precision', which are neither final nor equal to resume_from. */
+		fractal_set_all_chunks_unseen();
+	}
+	else {
+		//Points not escaping within 'precision' steps do not escape within fewer steps either,
+		//but their orbits are no longer known at step 'pr'
+		for (int i = 0; i < width * height; ++i) {
+			if (iteration_buffer[i] >= pr) {
+				iteration_buffer[i] = pr;
+				orbit_buffer[2 * i] = orbit_buffer[2 * i + 1] = NAN;
+			}
+		}
+		if (resume_from && pr <= resume_from) {
+			//The picture was finished at the precision to be resumed, so it is finished at 'pr' too
+			memset(chunks_done, true, chunk_count());
+			resume_from = 0;
+		}
+	}
+	precision = pr;
+	fractal_recolor();
+	return true;
+}
+
+int fractal_get_precision() {
+	return precision;
+}
+
+void fractal_set_single_precision(bool allowed) {
+	fractal_cancel_render();
+	single_precision_allowed = allowed;
+}
+
+bool fractal_get_single_precision() {
+	return single_precision_allowed;
+}
+
+void fractal_set_periodicity_check(bool enabled) {
+	fractal_cancel_render();
+	periodicity_check = enabled;
+}
+
+bool fractal_get_periodicity_check() {
+	return periodicity_check;
+}
+
+void fractal_set_auto_precision(bool enabled) {
+	fractal_cancel_render();
+	auto_precision = enabled;
+}
+
+bool fractal_get_auto_precision() {
+	return auto_precision;
+}
+
+void fractal_set_frame_budget(double seconds) {
+	assert(seconds >= 0.0);
+	fractal_cancel_render();
+	frame_budget = seconds;
+}
+
+double fractal_get_frame_budget() {
+	return frame_budget;
+}
+
+void fractal_set_prefetch(bool enabled, double pan, double scale) {
+	fractal_cancel_render();
+	prefetch.enabled = enabled;
+	prefetch.pan = pan;
+	prefetch.scale = scale;
+}
+
+bool fractal_get_prefetch() {
+	return prefetch.enabled;
+}
+
+static void print_render_stats(char const* name, struct render_stats const* s) {
+	long const pixels = s->pixels_computed + s->pixels_filled + s->pixels_mirrored + s->pixels_reused
+		+ s->pixels_resumed + s->pixels_cached;
+	fprintf(stderr, "    %s: %ld pixels, %ld computed, %ld filled by subdivision (%.1f %% skipped).\r\n"
+		, name, pixels, s->pixels_computed, s->pixels_filled, pixels ? 100.0 * s->pixels_filled / pixels : 0.0);
+	fprintf(stderr, "    %s: %ld pixels copied from their mirror image.\r\n", name, s->pixels_mirrored);
+	fprintf(stderr, "    %s: %ld pixels reused from the previous picture (%.1f %%).\r\n"
+		, name, s->pixels_reused, pixels ? 100.0 * s->pixels_reused / pixels : 0.0);
+	fprintf(stderr, "    %s: %ld pixels resumed after the precision was raised.\r\n", name, s->pixels_resumed);
+	fprintf(stderr, "    %s: %ld pixels copied from the tile cache.\r\n", name, s->pixels_cached);
+	fprintf(stderr, "    %s: periodicity check saved %ld iterations.\r\n", name, s->saved_iterations);
+	fprintf(stderr, "    %s: %ld glitched orbits rebased by perturbation.\r\n", name, s->orbits_rebased);
+	fprintf(stderr, "    %s: %ld chunks abandoned when the view changed.\r\n", name, s->chunks_abandoned);
+}
+
+void fractal_print_stats() {
+	fprintf(stderr, "INFO: Rendering statistics:\r\n");
+	print_render_stats("Last local computation", &last_render);
+	print_render_stats("Total", &total_render);
+	fprintf(stderr, "    Recent passes computed a pixel in %.1f ns.\r\n", pixel_cost() * 1e9);
+	tile_cache_print_stats();
+}
+
 void fractal_set_edge(enum boundary b, my_complex new_value) {
+	fractal_cancel_render();
+	deep.active = false;
 	if (b == bound_topleft) {
 		top_left = new_value;
 	}
@@ -231,7 +1916,14 @@ my_complex fractal_get_edge(enum boundary b) {
 	return b == bound_topleft ? top_left : bot_right;
 }
 
+bool fractal_is_deep() {
+	return deep.active;
+}
+
 my_complex fractal_get_center() {
+	if (deep.active) {
+		return mp_complex_to(deep.center);
+	}
 	my_complex middle = add(top_left, bot_right);
 	return scalar_mul(middle, 0.5);
 }
@@ -242,6 +1934,7 @@ my_complex fractal_get_constant() {
 }
 
 void fractal_set_constant(my_complex c) {
+	fractal_cancel_render();
 	constant = c;
 }
 
@@ -273,7 +1966,119 @@ int count_ppm_files() {
 }
 
 
+void fractal_set_supersampling(int grid) {
+	assert(grid > 0);
+	supersampling.grid = grid;
+}
+
+int fractal_get_supersampling() {
+	return supersampling.grid;
+}
+
+//Returns true iff the count of the pixel differs too much from any of its four neighbours
+static bool needs_supersampling(int pixel) {
+	int const row = pixel / width, col = pixel % width, count = *pixel_count(pixel);
+	int const neighbours[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+	for (int i = 0; i < 4; ++i) {
+		int const r = row + neighbours[i][1], c = col + neighbours[i][0];
+		if (r >= 0 && r < height && c >= 0 && c < width
+			&& abs(*pixel_count(r * width + c) - count) > supersampling.threshold) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Task computing the color of a single pixel of the export as the average of grid x grid samples
+ lying at centers of its subpixels. 'arg' is the rgb data of the export. */
+static void supersample_pixel(int pixel, int worker, void* arg) {
+	uint8_t* const rgb = arg;
+	int const grid = supersampling.grid, row = pixel / width, col = pixel % width;
+	double const sub = 1.0 / grid, first = sub / 2 - 0.5; //Offset of the first sample in pixels
+	int iterations[grid];
+	uint16_t counts[grid];
+	uint8_t colors[3 * grid];
+	int sum[3] = { 0, 0, 0 };
+	for (int i = 0; i < grid; ++i) {
+		double const y = row + first + i * sub;
+		if (deep.active) {
+			my_complex const offset = { (col + first - width / 2.0) * deep.dx, (height / 2.0 - y) * deep.dy };
+			compute_deep_samples(offset, deep.dx * sub, 0, 1, grid, precision, iterations);
+		}
+		else {
+			my_complex const start = { top_left.re + (col + first) * pixel_width(), top_left.im - y * pixel_height() };
+			convergence_test_row(start, pixel_width() * sub, 0, 1, grid, constant, precision,
+				local_kernel.tolerance, iterations, NULL);
+		}
+		for (int k = 0; k < grid; ++k) {
+			counts[k] = iterations[k];
+		}
+		palette_color_counts(counts, grid, colors);
+		for (int k = 0; k < 3 * grid; ++k) {
+			sum[k % 3] += colors[k];
+		}
+	}
+	for (int c = 0; c < 3; ++c) {
+		rgb[3 * pixel + c] = (sum[c] + grid * grid / 2) / (grid * grid);
+	}
+}
+
+/* Returns a copy of the frame buffer, whose high variance pixels are supersampled (to be freed
+ by the caller). Returns NULL if the picture is not finished or memory cannot be allocated. */
+static uint8_t* supersample() {
+	if (!fractal_finished()) {
+		fprintf(stderr, "WARN: The picture is not finished, it is exported without supersampling.\r\n");
+		return NULL;
+	}
+	uint8_t* const rgb = malloc(buffer_size);
+	int* const pixels = malloc(sizeof(int) * width * height);
+	if (!rgb || !pixels || !select_local_kernel(precision)) {
+		fprintf(stderr, "ERROR: Cannot supersample the picture, it is exported as it is.\r\n");
+		free(rgb);
+		free(pixels);
+		return NULL;
+	}
+	detile(rgb);
+	int count = 0;
+	for (int pixel = 0; pixel < width * height; ++pixel) {
+		if (needs_supersampling(pixel)) {
+			pixels[count++] = pixel;
+		}
+	}
+	if (render_threads > 1) {
+		pool_run(pixels, count, &supersample_pixel, rgb);
+	}
+	else {
+		for (int i = 0; i < count; ++i) {
+			supersample_pixel(pixels[i], 0, rgb);
+		}
+	}
+	free(pixels);
+
+	long const samples = (long)supersampling.grid * supersampling.grid;
+	long const full = (samples - 1) * width * height; //Extra samples taken by full supersampling
+	fprintf(stderr, "INFO: Supersampled %d of %d pixels by %dx%d samples: %ld extra samples instead of %ld (%.1f %%).\r\n",
+		count, width * height, supersampling.grid, supersampling.grid, count * samples, full,
+		100.0 * count * samples / full);
+	return rgb;
+}
+
 bool save_to_ppm() {
+	if (fractal_rendering()) {
+		fprintf(stderr, "INFO: Waiting for the picture being rendered.\r\n");
+		wait_for_render();
+	}
+	fractal_cancel_render(); //Prefetching would compete with supersampling for the rendering pool
+
+	//The image is prepared first, so that no file is left behind if it cannot be
+	uint8_t* image = supersampling.grid > 1 ? supersample() : NULL;
+	if (!image && (image = malloc(buffer_size))) {
+		detile(image);
+	}
+	if (!image) {
+		fprintf(stderr, "ERROR: Cannot allocate the exported image.\r\n");
+		return false;
+	}
 
 	int const count = count_ppm_files();
 	char buffer[128];
@@ -282,9 +2087,8 @@ bool save_to_ppm() {
 	FILE* const output = fopen(buffer, "wb");
 	assert(output);
 	fprintf(output, "P6\n%d\n%d\n255\n", width, height);
-
-
-	fwrite(frame_buffer, 3, width * height, output);
+	fwrite(image, 3, width * height, output);
+	free(image);
 	fclose(output);
 	fprintf(stderr, "INFO: Saved file as %s\r\n", buffer);
 	return true;
@@ -10,6 +10,13 @@ enum selection_policy {
 	policy_random //Any random unfinished chunk
 };
 
+//Chooses, how are pixels within a chunk evaluated by fractal_compute_locally
+enum render_mode {
+	render_full, //Every single pixel is iterated
+	render_subdivide, //Rectangles with uniform border are filled without iterating their interior
+	render_progressive //Passes at 1/16, 1/4 and full resolution, each reusing the previous one
+};
+
 //Distinguishes between two edges defining the visible section of complex plane
 enum boundary {
 	bound_topleft,
@@ -25,6 +32,9 @@ void fractal_cleanup();
 
 /*Resize the window. Dimensions must be divisible by 10.*/
 bool fractal_set_image_size(int width, int height);
+//Getters for dimensions of the picture in pixels
+int fractal_get_width();
+int fractal_get_height();
 
 /* Directly modifies the underlying buffer of raw pixels. */
 void fractal_write_pixel(int row, int col, int r, int g, int b);
@@ -32,13 +42,23 @@ void fractal_write_pixel(int row, int col, int r, int g, int b);
 /* Writes a pixel in given chunk with given relative coordinates. */
 void fractal_add_point(int chunk_id, int relative_col, int relative_row, int iterations);
 
-/* Getter for config required by Nucleo (message set_compute). */
+/* Derives colors of all pixels from their stored iteration counts (e.g. after the palette changed). */
+void fractal_recolor();
+
+/* Colors whole row of a chunk at once. 'iterations' must contain one count per each column of the chunk. */
+void fractal_add_row(int chunk_id, int relative_row, int const* iterations);
+
+/* Getter for config required by Nucleo (message set_compute). The precision must not exceed UINT8_MAX. */
 msg_set_compute fractal_get_settings();
 
-/* Returns data about the next chunk, for which data colors shall be computed. */
-msg_compute fractal_get_next_chunk();
+/* Stores data about the next chunk, for which colors shall be computed, to 'chunk'.
+ Chunks found in the tile cache are filled and finished on the way. Returns false
+ (leaving 'chunk' untouched) if no chunk remains to be computed. Local computation must not
+ run meanwhile, cancel it (see fractal_cancel_render) before handing chunks to the Nucleo. */
+bool fractal_get_next_chunk(msg_compute* chunk);
 
-/* Report that all pixels within this chunk have been filled. Advances to a next one. */
+/* Report that all pixels within this chunk have been filled by the Nucleo. Advances to a next one.
+ Its counts are not stored to the tile cache, nor are those of chunks later computed from them. */
 void fractal_finish_chunk();
 
 //Return true iff all pixels of all chunks are filled.
@@ -56,9 +76,54 @@ void fractal_redraw();
 //Resets chunk data - window is not affected, but a new computation can be initiated
 void fractal_set_all_chunks_unseen();
 
+/* Moves the visible rectangle by whole pixels (positive values move right and down).
+ Pixels remaining visible are shifted within the frame buffer, only chunks uncovering
+ new area are marked unseen. */
+void fractal_pan(int cols, int rows);
+
+/* Scales the visible rectangle about its center by 'scale' (< 1 zooms in). Pixels lying
+ at the same points of the plane as pixels of the previous (finished) picture are resampled,
+ full mode of local computation skips them. Returns the fraction of resampled pixels.
+ Views too deep for double precision are kept in multiprecision (see fractal_is_deep).
+ Zooming in is refused (keeping the view and returning 1) once pixels would be closer
+ than MP_MIN_SPACING. */
+double fractal_zoom(double scale);
+
 //Compute all chunks using local CPU (don't delegate to worker module)
 void fractal_compute_locally();
 
+/* Computes all chunks locally by a background job and returns immediately. Every function
+ changing the view (zoom, pan, constant, precision, ...) cancels the job in flight first:
+ it abandons its remaining chunks once those being computed are finished. Chunks done
+ by then stay valid, so a new job only computes those still missing. */
+void fractal_render_async();
+
+//Cancels the background job (if any) and waits until it stops
+void fractal_cancel_render();
+
+//Returns true iff a background job is requested or running
+bool fractal_rendering();
+
+/* Speculative prefetch. Once a background job finishes its view, the idle rendering thread
+ computes chunks of the views a single move away into the tile cache (see tile_cache_prefetch):
+ pans by 'pan' of the picture side and zooms by 'scale' and 1 / 'scale', the last move first.
+ Any real work preempts it at the next chunk boundary. */
+void fractal_set_prefetch(bool enabled, double pan, double scale);
+
+bool fractal_get_prefetch();
+
+/* Dynamic resolution for interactive navigation. With a positive budget (in seconds), the first
+ pass of local computation samples pending chunks sparsely enough to fit it at the recent cost
+ of a pixel and paints each sample as a block. Finer passes (halving blocks down to single
+ pixels as in progressive rendering) start once the view stays unchanged for the budget.
+ Zero restores rendering by the render mode alone. */
+void fractal_set_frame_budget(double seconds);
+
+double fractal_get_frame_budget();
+
+//Blocks until a pass of local computation finishes or the timeout (in ms) elapses
+void fractal_wait_for_update(int timeout_ms);
+
 //Determines, how many chunks make up a row and a column. Thus controls the size
 //of chunks, which are considered computation primitive.
 bool fractal_set_screen_division(int rows, int columns);
@@ -66,6 +131,51 @@ bool fractal_set_screen_division(int rows, int columns);
 //Sets the desird policy for selecting unfinished chunks
 void fractal_set_selection_policy(enum selection_policy p);
 
+//Sets the way pixels of chunks are evaluated during local computation
+void fractal_set_render_mode(enum render_mode m);
+
+/* Sets maximal number of iterations per pixel and recolors the picture by a rebuilt palette.
+ Lowering the precision is final, raising it marks all chunks unseen as pixels which reached
+ the former limit have to be iterated further. */
+bool fractal_set_precision(int precision);
+//Returns maximal number of iterations per pixel
+int fractal_get_precision();
+
+//Allows (or forbids) fractal_compute_locally to use single precision kernels on shallow zooms
+void fractal_set_single_precision(bool allowed);
+//Returns true iff single precision kernels may be used
+bool fractal_get_single_precision();
+
+//Enables detection of periodic orbits, which finishes points inside the set early
+void fractal_set_periodicity_check(bool enabled);
+//Returns true iff periodic orbits are being detected
+bool fractal_get_periodicity_check();
+
+/* Chooses the lowest precision (at most 'limit'), at which nearly all samples of a sparse preview
+ of the view are classified (escaping or not) the same as at 'limit', and sets it. Keeps the current
+ precision if it is good enough and not much higher. Returns the precision set. */
+int fractal_adapt_precision(int limit);
+
+//Makes fractal_compute_locally adapt the precision to each view
+void fractal_set_auto_precision(bool enabled);
+
+bool fractal_get_auto_precision();
+
+//Prints counters gathered during local computation to stderr
+void fractal_print_stats();
+
+/* Sets number of threads used by fractal_compute_locally. With a single thread chunks
+ are computed one by one on the calling thread (reference mode). Returns false if threads
+ cannot be started, the reference mode is used then. */
+bool fractal_set_thread_count(int threads);
+//Returns number of threads used by local computation
+int fractal_get_thread_count();
+
+//Enables copying of pixels mirrored under z -> -z instead of computing them
+void fractal_set_symmetry(bool enabled);
+//Returns true iff the symmetry of Julia sets is exploited
+bool fractal_get_symmetry();
+
 //Sets new coordinates of visible rectangle
 void fractal_set_edge(enum boundary b, my_complex new_value);
 //Sets new value for constant C
@@ -74,11 +184,22 @@ void fractal_set_constant(my_complex c);
 my_complex fractal_get_edge(enum boundary);
 //Geter returning coordinates of the point in the middle of the screen
 my_complex fractal_get_center();
+
+/* Returns true iff the view is too deep for double precision (see fractal_zoom). Its bounds
+ are then only approximate, it can be computed locally (in double-double or by perturbation),
+ but not by Nucleo. */
+bool fractal_is_deep();
 //Getter for constant C used in the Julia set computation
 my_complex fractal_get_constant();
 
 //Export the current frame_buffer to ppm file "fractal.ppm"
 //Return true on success
 bool save_to_ppm();
+
+/* Export quality of save_to_ppm. Pixels of a finished picture whose iteration count differs from
+ their neighbours are computed again as the average of grid x grid samples. Grid 1 turns it off. */
+void fractal_set_supersampling(int grid);
+int fractal_get_supersampling();
+
 #endif
 
@@ -15,6 +15,10 @@ struct JuliaSetComputer {
 	float dx = 0.0f, dy = 0.0f;
 	int precision = 0;
 
+	//Zero tolerance disables detection of periodic orbits
+	double tolerance = 0.0;
+	long saved_iterations = 0;
+
 	//fixed point towards which coordinates are calculated
 	my_complex upper_left_corner{ 0.0,0.0 };
 	int chunk_id = 0, width = 0, height = 0;
@@ -31,6 +35,7 @@ public:
 		dx = msg.d_re;
 		dy = msg.d_im;
 		precision = msg.n;
+		tolerance = msg.flags & SET_COMPUTE_PERIODICITY ? periodicity_tolerance(dx, dy) : 0.0;
 	}
 
 	void start_computation(msg_compute const& msg) {
@@ -49,7 +54,9 @@ public:
 		result.cid = chunk_id;
 		result.i_im = row;
 		result.i_re = col;
-		result.iter = convergence_test(point, constant, precision);
+		result.iter = tolerance > 0.0
+			? convergence_test_periodic(point, constant, precision, tolerance, &saved_iterations)
+			: convergence_test(point, constant, precision);
 		if (++col == width) {
 			col = 0;
 			if (++row == height) {
@@ -49,6 +49,36 @@ int convergence_test(my_complex point, my_complex c, int max_steps) {
 	return max_steps;
 }
 
+int convergence_test_periodic(my_complex point, my_complex c, int max_steps, double tolerance, long* saved) {
+	if (magnitude_squared(point) >= 4.0f) {
+		return 0;
+	}
+
+	double const tolerance_squared = tolerance * tolerance;
+	my_complex reference = point;
+	int next_save = 1;
+	for (int i = 1; i <= max_steps; ++i) {
+		if (magnitude_squared(point) >= 4.0f) {
+			return i;
+		}
+		point = add(c, mul(point, point));
+		if (magnitude_squared(sub(point, reference)) < tolerance_squared) {
+			*saved += max_steps - i;
+			return max_steps;
+		}
+		if (i == next_save) {
+			reference = point;
+			next_save *= 2;
+		}
+	}
+	return max_steps;
+}
+
+double periodicity_tolerance(double dx, double dy) {
+	//A small fraction of the pixel is still far above rounding errors of the orbit
+	return fmin(fabs(dx), fabs(dy)) / 1024;
+}
+
 
 
 uint8_t red_component(int first_lost, int max_steps) {
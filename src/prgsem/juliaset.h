@@ -26,6 +26,16 @@ double magnitude(my_complex);
   Returns index k of the first z_k, that does not fall into the magnitude <= 2.0f range. */
 int convergence_test(my_complex point, my_complex c, int max_steps);
 
+/* Same as convergence_test, but additionally detects periodic orbits using Brent's method.
+ The orbit is compared against a reference z saved at steps 1, 2, 4, 8...; once it returns
+ closer than 'tolerance' to it, the point is declared to be in the set and max_steps is returned.
+ Number of iterations skipped this way is added to *saved. */
+int convergence_test_periodic(my_complex point, my_complex c, int max_steps, double tolerance, long* saved);
+
+/* Tolerance for periodicity checking suitable for pixels dx by dy apart. Shrinks with zoom,
+ so that distinct neighbouring pixels are never considered the same point of an orbit. */
+double periodicity_tolerance(double dx, double dy);
+
 /* Separate color components. Calculation based on selected precision (max_steps) and the
 actual number of steps required to make the series diverge. */
 uint8_t red_component(int first_lost, int max_steps);
@@ -0,0 +1,933 @@
+
+#include "juliaset_batch.h"
+
+#include <float.h>
+#include <assert.h>
+#include <stddef.h>
+#include <math.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define BATCH_X86
+#endif
+
+typedef long (*row_kernel)(my_complex start, double step, int first, int stride, int count,
+	my_complex c, int max_steps, double tolerance, int* iterations, float* orbits);
+typedef long (*resume_kernel)(float* orbits, int count, my_complex c, int from, int max_steps,
+	double tolerance, int* iterations);
+typedef void (*double_double_kernel)(my_complex start_hi, my_complex start_lo, double step, int first,
+	int stride, int count, my_complex c, int max_steps, int* iterations);
+
+/* Steps 'from' to 'max_steps' of convergence_test_periodic, 'point' being the z examined at step
+ 'from'. Reference points of Brent's method are saved 1, 2, 4... steps after 'from'. Unless 'orbit'
+ is NULL, z examined at the last step is stored to it as a pair of floats if the point does not escape. */
+static int iterate_orbit(my_complex point, my_complex c, int from, int max_steps, double tolerance,
+	long* saved, float* orbit) {
+	double const tolerance_squared = tolerance * tolerance;
+	my_complex reference = point;
+	int next_save = from, span = 1;
+	for (int i = from; i <= max_steps; ++i) {
+		if (point.re * point.re + point.im * point.im >= 4.0f) {
+			return i;
+		}
+		if (orbit && i == max_steps) {
+			orbit[0] = point.re;
+			orbit[1] = point.im;
+		}
+		point = add(c, mul(point, point));
+		my_complex const d = sub(point, reference);
+		if (d.re * d.re + d.im * d.im < tolerance_squared) {
+			*saved += max_steps - i;
+			return max_steps;
+		}
+		if (i == next_save) {
+			reference = point;
+			next_save += span;
+			span *= 2;
+		}
+	}
+	return max_steps;
+}
+
+static long resume_scalar(float* const orbits, int const count, my_complex const c, int const from,
+	int const max_steps, double const tolerance, int* const iterations) {
+	long saved = 0;
+	for (int k = 0; k < count; ++k) {
+		my_complex const point = { orbits[2 * k], orbits[2 * k + 1] };
+		iterations[k] = iterate_orbit(point, c, from, max_steps, tolerance, &saved, orbits + 2 * k);
+	}
+	return saved;
+}
+
+/* Single precision counterpart of convergence_test_periodic. Used by the scalar kernel
+ and to finish row tails not filling the whole vector. Zero tolerance never detects a cycle. */
+static int convergence_test_float(float re, float im, float c_re, float c_im, int max_steps,
+	float tolerance_squared, long* saved, float* orbit) {
+	if (re * re + im * im >= 4.0f) {
+		return 0;
+	}
+
+	float ref_re = re, ref_im = im;
+	int next_save = 1;
+	for (int i = 1; i <= max_steps; ++i) {
+		float const re2 = re * re, im2 = im * im;
+		if (re2 + im2 >= 4.0f) {
+			return i;
+		}
+		if (orbit && i == max_steps) {
+			orbit[0] = re;
+			orbit[1] = im;
+		}
+		float const t = re * im;
+		im = t + t + c_im;
+		re = re2 - im2 + c_re;
+
+		float const d_re = re - ref_re, d_im = im - ref_im;
+		if (d_re * d_re + d_im * d_im < tolerance_squared) {
+			*saved += max_steps - i;
+			return max_steps;
+		}
+		if (i == next_save) {
+			ref_re = re;
+			ref_im = im;
+			next_save *= 2;
+		}
+	}
+	return max_steps;
+}
+
+static long row_scalar(my_complex start, double const step, int const first, int const stride,
+	int const count, my_complex const c, int const max_steps, double const tolerance, int* const iterations,
+	float* const orbits) {
+	long saved = 0;
+	for (int k = 0; k < count; ++k) {
+		my_complex const point = { start.re + (first + k * stride) * step, start.im };
+		if (orbits) {
+			iterations[k] = point.re * point.re + point.im * point.im >= 4.0f ? 0
+				: iterate_orbit(point, c, 1, max_steps, tolerance, &saved, orbits + 2 * k);
+		}
+		else {
+			iterations[k] = tolerance > 0.0
+				? convergence_test_periodic(point, c, max_steps, tolerance, &saved)
+				: convergence_test(point, c, max_steps);
+		}
+	}
+	return saved;
+}
+
+static long row_scalar_float(my_complex start, double const step, int const first, int const stride,
+	int const count, my_complex const c, int const max_steps, double const tolerance, int* const iterations,
+	float* const orbits) {
+	long saved = 0;
+	for (int k = 0; k < count; ++k) {
+		iterations[k] = convergence_test_float(start.re + (first + k * stride) * step, start.im, c.re, c.im,
+			max_steps, tolerance * tolerance, &saved, orbits ? orbits + 2 * k : NULL);
+	}
+	return saved;
+}
+
+/* Double-double numbers are unevaluated sums hi + lo with |lo| <= ulp(hi) / 2, i.e. about
+ 106 bits of mantissa. They are built on error-free transformations: the rounding error of
+ a sum is recovered by two_sum and that of a product by a single fused multiply-add. */
+typedef struct double_double {
+	double hi, lo;
+} double_double;
+
+static inline double_double two_sum(double const a, double const b) {
+	double const s = a + b, v = s - a;
+	double_double const result = { s, (a - (s - v)) + (b - v) };
+	return result;
+}
+
+//Requires |a| >= |b|
+static inline double_double quick_two_sum(double const a, double const b) {
+	double const s = a + b;
+	double_double const result = { s, b - (s - a) };
+	return result;
+}
+
+static inline double_double dd_add(double_double const a, double_double const b) {
+	double_double s = two_sum(a.hi, b.hi);
+	double_double const t = two_sum(a.lo, b.lo);
+	s = quick_two_sum(s.hi, s.lo + t.hi);
+	return quick_two_sum(s.hi, s.lo + t.lo);
+}
+
+static inline double_double dd_mul(double_double const a, double_double const b) {
+	double const p = a.hi * b.hi;
+	double const e = fma(a.hi, b.hi, -p);
+	return quick_two_sum(p, e + (a.hi * b.lo + a.lo * b.hi));
+}
+
+static inline double_double dd_neg(double_double const a) {
+	double_double const result = { -a.hi, -a.lo };
+	return result;
+}
+
+/* Same steps as convergence_test, but z is kept in double-double. Escape is decided by
+ the high parts, which carry all of |z| the comparison can tell. Their squares are rounded
+ before they are summed (no FMA), exactly as vector kernels do, so that all kernels agree. */
+static int convergence_test_dd(double_double re, double_double im, my_complex const c, int const max_steps) {
+	double_double const c_re = { c.re, 0.0 }, c_im = { c.im, 0.0 };
+	if (re.hi * re.hi + im.hi * im.hi >= 4.0) {
+		return 0;
+	}
+	for (int i = 1; i <= max_steps; ++i) {
+		if (re.hi * re.hi + im.hi * im.hi >= 4.0) {
+			return i;
+		}
+		double_double const t = dd_mul(re, im);
+		double_double const twice = { 2 * t.hi, 2 * t.lo };
+		re = dd_add(dd_add(dd_mul(re, re), dd_neg(dd_mul(im, im))), c_re);
+		im = dd_add(twice, c_im);
+	}
+	return max_steps;
+}
+
+static void row_scalar_dd(my_complex const start_hi, my_complex const start_lo, double const step,
+	int const first, int const stride, int const count, my_complex const c, int const max_steps,
+	int* const iterations) {
+	double_double const start_re = { start_hi.re, start_lo.re }, start_im = { start_hi.im, start_lo.im };
+	for (int k = 0; k < count; ++k) {
+		//The offset is an exact product of two doubles
+		double const index = first + k * stride, offset = index * step;
+		double_double const delta = { offset, fma(index, step, -offset) };
+		iterations[k] = convergence_test_dd(dd_add(start_re, delta), start_im, c, max_steps);
+	}
+}
+
+/* Each vector kernel evaluates 'lanes' neighbouring points at once. A lane leaves the
+ active mask as soon as its point escapes and its step count is recorded. The loop stops
+ when all lanes escaped or max_steps is reached. Points that do not fill a whole vector
+ are handed to the scalar kernel. Operations are ordered the same way as in scalar code,
+ so the double precision kernels give bit exact results of convergence_test(_periodic).
+
+ With nonzero tolerance each lane also keeps a reference point of its orbit. All lanes
+ share the same Brent schedule (save at steps 1, 2, 4, 8...), so only the comparison
+ needs to be masked. Lanes returning to their reference leave as if they never escaped. */
+
+#ifdef BATCH_X86
+
+//Store 'value' to all lanes of 'out' selected by bits of 'mask'
+static inline void record_lanes(int* const out, unsigned mask, int const value) {
+	for (; mask; mask &= mask - 1) {
+		out[__builtin_ctz(mask)] = value;
+	}
+}
+
+//Store z of lanes selected by 'mask' as pairs of floats, so that their iteration can be resumed
+static inline void record_orbits(float* const out, unsigned mask, double const* re, double const* im) {
+	for (; mask; mask &= mask - 1) {
+		int const lane = __builtin_ctz(mask);
+		out[2 * lane] = re[lane];
+		out[2 * lane + 1] = im[lane];
+	}
+}
+
+static inline void record_orbits_float(float* const out, unsigned mask, float const* re, float const* im) {
+	for (; mask; mask &= mask - 1) {
+		int const lane = __builtin_ctz(mask);
+		out[2 * lane] = re[lane];
+		out[2 * lane + 1] = im[lane];
+	}
+}
+
+//Finish lanes found periodic at step i. Returns number of iterations saved by them.
+static inline long record_periodic(int* const out, unsigned const mask, int const i, int const max_steps) {
+	record_lanes(out, mask, max_steps);
+	return (long)__builtin_popcount(mask) * (max_steps - i);
+}
+
+static long row_sse2(my_complex start, double const step, int const first, int const stride,
+	int const count, my_complex const c, int const max_steps, double const tolerance, int* const iterations,
+	float* const orbits) {
+	__m128d const c_re = _mm_set1_pd(c.re), c_im = _mm_set1_pd(c.im);
+	__m128d const four = _mm_set1_pd(4.0), vstep = _mm_set1_pd(step), vstart = _mm_set1_pd(start.re);
+	__m128d const lane_offsets = _mm_set_pd(stride, 0.0);
+	enum { lanes = 2, all = (1 << lanes) - 1 };
+
+	__m128d const tol2 = _mm_set1_pd(tolerance * tolerance);
+	long saved = 0;
+
+	int k = 0;
+	for (; k + lanes <= count; k += lanes) {
+		int* const out = iterations + k;
+		__m128d const index = _mm_add_pd(_mm_set1_pd(first + k * stride), lane_offsets);
+		__m128d re = _mm_add_pd(vstart, _mm_mul_pd(index, vstep));
+		__m128d im = _mm_set1_pd(start.im);
+		__m128d re2 = _mm_mul_pd(re, re), im2 = _mm_mul_pd(im, im);
+
+		unsigned escaped = _mm_movemask_pd(_mm_cmpge_pd(_mm_add_pd(re2, im2), four));
+		record_lanes(out, escaped, 0);
+		unsigned active = all & ~escaped;
+		__m128d ref_re = re, ref_im = im;
+		int next_save = 1;
+
+		for (int i = 1; i <= max_steps && active; ++i) {
+			escaped = active & _mm_movemask_pd(_mm_cmpge_pd(_mm_add_pd(re2, im2), four));
+			record_lanes(out, escaped, i);
+			active &= ~escaped;
+			if (orbits && i == max_steps) {
+				double z_re[lanes], z_im[lanes];
+				_mm_storeu_pd(z_re, re);
+				_mm_storeu_pd(z_im, im);
+				record_orbits(orbits + 2 * k, active, z_re, z_im);
+			}
+
+			__m128d const t = _mm_mul_pd(re, im);
+			im = _mm_add_pd(c_im, _mm_add_pd(t, t));
+			re = _mm_add_pd(c_re, _mm_sub_pd(re2, im2));
+			re2 = _mm_mul_pd(re, re);
+			im2 = _mm_mul_pd(im, im);
+
+			if (tolerance > 0.0) {
+				__m128d const d_re = _mm_sub_pd(re, ref_re), d_im = _mm_sub_pd(im, ref_im);
+				__m128d const d2 = _mm_add_pd(_mm_mul_pd(d_re, d_re), _mm_mul_pd(d_im, d_im));
+				unsigned const periodic = active & _mm_movemask_pd(_mm_cmplt_pd(d2, tol2));
+				saved += record_periodic(out, periodic, i, max_steps);
+				active &= ~periodic;
+				if (i == next_save) {
+					ref_re = re;
+					ref_im = im;
+					next_save *= 2;
+				}
+			}
+		}
+		record_lanes(out, active, max_steps);
+	}
+	return saved + row_scalar(start, step, first + k * stride, stride, count - k, c, max_steps,
+		tolerance, iterations + k, orbits ? orbits + 2 * k : NULL);
+}
+
+static long row_sse2_float(my_complex start, double const step, int const first, int const stride,
+	int const count, my_complex const c, int const max_steps, double const tolerance, int* const iterations,
+	float* const orbits) {
+	__m128 const c_re = _mm_set1_ps(c.re), c_im = _mm_set1_ps(c.im), four = _mm_set1_ps(4.0f);
+	enum { lanes = 4, all = (1 << lanes) - 1 };
+
+	__m128 const tol2 = _mm_set1_ps(tolerance * tolerance);
+	long saved = 0;
+
+	int k = 0;
+	for (; k + lanes <= count; k += lanes) {
+		int* const out = iterations + k;
+		int const i0 = first + k * stride;
+		__m128 re = _mm_set_ps(start.re + (i0 + 3 * stride) * step, start.re + (i0 + 2 * stride) * step,
+			start.re + (i0 + stride) * step, start.re + i0 * step);
+		__m128 im = _mm_set1_ps(start.im);
+		__m128 re2 = _mm_mul_ps(re, re), im2 = _mm_mul_ps(im, im);
+
+		unsigned escaped = _mm_movemask_ps(_mm_cmpge_ps(_mm_add_ps(re2, im2), four));
+		record_lanes(out, escaped, 0);
+		unsigned active = all & ~escaped;
+		__m128 ref_re = re, ref_im = im;
+		int next_save = 1;
+
+		for (int i = 1; i <= max_steps && active; ++i) {
+			escaped = active & _mm_movemask_ps(_mm_cmpge_ps(_mm_add_ps(re2, im2), four));
+			record_lanes(out, escaped, i);
+			active &= ~escaped;
+			if (orbits && i == max_steps) {
+				float z_re[lanes], z_im[lanes];
+				_mm_storeu_ps(z_re, re);
+				_mm_storeu_ps(z_im, im);
+				record_orbits_float(orbits + 2 * k, active, z_re, z_im);
+			}
+
+			__m128 const t = _mm_mul_ps(re, im);
+			im = _mm_add_ps(_mm_add_ps(t, t), c_im);
+			re = _mm_add_ps(_mm_sub_ps(re2, im2), c_re);
+			re2 = _mm_mul_ps(re, re);
+			im2 = _mm_mul_ps(im, im);
+
+			if (tolerance > 0.0) {
+				__m128 const d_re = _mm_sub_ps(re, ref_re), d_im = _mm_sub_ps(im, ref_im);
+				__m128 const d2 = _mm_add_ps(_mm_mul_ps(d_re, d_re), _mm_mul_ps(d_im, d_im));
+				unsigned const periodic = active & _mm_movemask_ps(_mm_cmplt_ps(d2, tol2));
+				saved += record_periodic(out, periodic, i, max_steps);
+				active &= ~periodic;
+				if (i == next_save) {
+					ref_re = re;
+					ref_im = im;
+					next_save *= 2;
+				}
+			}
+		}
+		record_lanes(out, active, max_steps);
+	}
+	return saved + row_scalar_float(start, step, first + k * stride, stride, count - k, c, max_steps,
+		tolerance, iterations + k, orbits ? orbits + 2 * k : NULL);
+}
+
+__attribute__((target("avx2")))
+static long row_avx2(my_complex start, double const step, int const first, int const stride,
+	int const count, my_complex const c, int const max_steps, double const tolerance, int* const iterations,
+	float* const orbits) {
+	__m256d const c_re = _mm256_set1_pd(c.re), c_im = _mm256_set1_pd(c.im);
+	__m256d const four = _mm256_set1_pd(4.0), vstep = _mm256_set1_pd(step);
+	__m256d const vstart = _mm256_set1_pd(start.re);
+	__m256d const lane_offsets = _mm256_set_pd(3 * stride, 2 * stride, stride, 0.0);
+	enum { lanes = 4, all = (1 << lanes) - 1 };
+
+	__m256d const tol2 = _mm256_set1_pd(tolerance * tolerance);
+	long saved = 0;
+
+	int k = 0;
+	for (; k + lanes <= count; k += lanes) {
+		int* const out = iterations + k;
+		__m256d const index = _mm256_add_pd(_mm256_set1_pd(first + k * stride), lane_offsets);
+		__m256d re = _mm256_add_pd(vstart, _mm256_mul_pd(index, vstep));
+		__m256d im = _mm256_set1_pd(start.im);
+		__m256d re2 = _mm256_mul_pd(re, re), im2 = _mm256_mul_pd(im, im);
+
+		unsigned escaped = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_add_pd(re2, im2), four, _CMP_GE_OQ));
+		record_lanes(out, escaped, 0);
+		unsigned active = all & ~escaped;
+		__m256d ref_re = re, ref_im = im;
+		int next_save = 1;
+
+		for (int i = 1; i <= max_steps && active; ++i) {
+			escaped = active & _mm256_movemask_pd(_mm256_cmp_pd(_mm256_add_pd(re2, im2), four, _CMP_GE_OQ));
+			record_lanes(out, escaped, i);
+			active &= ~escaped;
+			if (orbits && i == max_steps) {
+				double z_re[lanes], z_im[lanes];
+				_mm256_storeu_pd(z_re, re);
+				_mm256_storeu_pd(z_im, im);
+				record_orbits(orbits + 2 * k, active, z_re, z_im);
+			}
+
+			__m256d const t = _mm256_mul_pd(re, im);
+			im = _mm256_add_pd(c_im, _mm256_add_pd(t, t));
+			re = _mm256_add_pd(c_re, _mm256_sub_pd(re2, im2));
+			re2 = _mm256_mul_pd(re, re);
+			im2 = _mm256_mul_pd(im, im);
+
+			if (tolerance > 0.0) {
+				__m256d const d_re = _mm256_sub_pd(re, ref_re), d_im = _mm256_sub_pd(im, ref_im);
+				__m256d const d2 = _mm256_add_pd(_mm256_mul_pd(d_re, d_re), _mm256_mul_pd(d_im, d_im));
+				unsigned const periodic = active & _mm256_movemask_pd(_mm256_cmp_pd(d2, tol2, _CMP_LT_OQ));
+				saved += record_periodic(out, periodic, i, max_steps);
+				active &= ~periodic;
+				if (i == next_save) {
+					ref_re = re;
+					ref_im = im;
+					next_save *= 2;
+				}
+			}
+		}
+		record_lanes(out, active, max_steps);
+	}
+	return saved + row_scalar(start, step, first + k * stride, stride, count - k, c, max_steps,
+		tolerance, iterations + k, orbits ? orbits + 2 * k : NULL);
+}
+
+__attribute__((target("avx2")))
+static long row_avx2_float(my_complex start, double const step, int const first, int const stride,
+	int const count, my_complex const c, int const max_steps, double const tolerance, int* const iterations,
+	float* const orbits) {
+	__m256 const c_re = _mm256_set1_ps(c.re), c_im = _mm256_set1_ps(c.im), four = _mm256_set1_ps(4.0f);
+	enum { lanes = 8, all = (1 << lanes) - 1 };
+
+	__m256 const tol2 = _mm256_set1_ps(tolerance * tolerance);
+	long saved = 0;
+
+	int k = 0;
+	for (; k + lanes <= count; k += lanes) {
+		int* const out = iterations + k;
+		float first_re[lanes];
+		for (int l = 0; l < lanes; ++l) {
+			first_re[l] = start.re + (first + (k + l) * stride) * step;
+		}
+		__m256 re = _mm256_loadu_ps(first_re);
+		__m256 im = _mm256_set1_ps(start.im);
+		__m256 re2 = _mm256_mul_ps(re, re), im2 = _mm256_mul_ps(im, im);
+
+		unsigned escaped = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_add_ps(re2, im2), four, _CMP_GE_OQ));
+		record_lanes(out, escaped, 0);
+		unsigned active = all & ~escaped;
+		__m256 ref_re = re, ref_im = im;
+		int next_save = 1;
+
+		for (int i = 1; i <= max_steps && active; ++i) {
+			escaped = active & _mm256_movemask_ps(_mm256_cmp_ps(_mm256_add_ps(re2, im2), four, _CMP_GE_OQ));
+			record_lanes(out, escaped, i);
+			active &= ~escaped;
+			if (orbits && i == max_steps) {
+				float z_re[lanes], z_im[lanes];
+				_mm256_storeu_ps(z_re, re);
+				_mm256_storeu_ps(z_im, im);
+				record_orbits_float(orbits + 2 * k, active, z_re, z_im);
+			}
+
+			__m256 const t = _mm256_mul_ps(re, im);
+			im = _mm256_add_ps(_mm256_add_ps(t, t), c_im);
+			re = _mm256_add_ps(_mm256_sub_ps(re2, im2), c_re);
+			re2 = _mm256_mul_ps(re, re);
+			im2 = _mm256_mul_ps(im, im);
+
+			if (tolerance > 0.0) {
+				__m256 const d_re = _mm256_sub_ps(re, ref_re), d_im = _mm256_sub_ps(im, ref_im);
+				__m256 const d2 = _mm256_add_ps(_mm256_mul_ps(d_re, d_re), _mm256_mul_ps(d_im, d_im));
+				unsigned const periodic = active & _mm256_movemask_ps(_mm256_cmp_ps(d2, tol2, _CMP_LT_OQ));
+				saved += record_periodic(out, periodic, i, max_steps);
+				active &= ~periodic;
+				if (i == next_save) {
+					ref_re = re;
+					ref_im = im;
+					next_save *= 2;
+				}
+			}
+		}
+		record_lanes(out, active, max_steps);
+	}
+	return saved + row_scalar_float(start, step, first + k * stride, stride, count - k, c, max_steps,
+		tolerance, iterations + k, orbits ? orbits + 2 * k : NULL);
+}
+
+__attribute__((target("avx512f")))
+static long row_avx512(my_complex start, double const step, int const first, int const stride,
+	int const count, my_complex const c, int const max_steps, double const tolerance, int* const iterations,
+	float* const orbits) {
+	__m512d const c_re = _mm512_set1_pd(c.re), c_im = _mm512_set1_pd(c.im);
+	__m512d const four = _mm512_set1_pd(4.0), vstep = _mm512_set1_pd(step);
+	__m512d const vstart = _mm512_set1_pd(start.re);
+	__m512d const lane_offsets = _mm512_set_pd(7 * stride, 6 * stride, 5 * stride, 4 * stride,
+		3 * stride, 2 * stride, stride, 0.0);
+	enum { lanes = 8, all = (1 << lanes) - 1 };
+
+	__m512d const tol2 = _mm512_set1_pd(tolerance * tolerance);
+	long saved = 0;
+
+	int k = 0;
+	for (; k + lanes <= count; k += lanes) {
+		int* const out = iterations + k;
+		__m512d const index = _mm512_add_pd(_mm512_set1_pd(first + k * stride), lane_offsets);
+		__m512d re = _mm512_add_pd(vstart, _mm512_mul_pd(index, vstep));
+		__m512d im = _mm512_set1_pd(start.im);
+		__m512d re2 = _mm512_mul_pd(re, re), im2 = _mm512_mul_pd(im, im);
+
+		unsigned escaped = _mm512_cmp_pd_mask(_mm512_add_pd(re2, im2), four, _CMP_GE_OQ);
+		record_lanes(out, escaped, 0);
+		unsigned active = all & ~escaped;
+		__m512d ref_re = re, ref_im = im;
+		int next_save = 1;
+
+		for (int i = 1; i <= max_steps && active; ++i) {
+			escaped = _mm512_mask_cmp_pd_mask(active, _mm512_add_pd(re2, im2), four, _CMP_GE_OQ);
+			record_lanes(out, escaped, i);
+			active &= ~escaped;
+			if (orbits && i == max_steps) {
+				double z_re[lanes], z_im[lanes];
+				_mm512_storeu_pd(z_re, re);
+				_mm512_storeu_pd(z_im, im);
+				record_orbits(orbits + 2 * k, active, z_re, z_im);
+			}
+
+			__m512d const t = _mm512_mul_pd(re, im);
+			im = _mm512_add_pd(c_im, _mm512_add_pd(t, t));
+			re = _mm512_add_pd(c_re, _mm512_sub_pd(re2, im2));
+			re2 = _mm512_mul_pd(re, re);
+			im2 = _mm512_mul_pd(im, im);
+
+			if (tolerance > 0.0) {
+				__m512d const d_re = _mm512_sub_pd(re, ref_re), d_im = _mm512_sub_pd(im, ref_im);
+				__m512d const d2 = _mm512_add_pd(_mm512_mul_pd(d_re, d_re), _mm512_mul_pd(d_im, d_im));
+				unsigned const periodic = _mm512_mask_cmp_pd_mask(active, d2, tol2, _CMP_LT_OQ);
+				saved += record_periodic(out, periodic, i, max_steps);
+				active &= ~periodic;
+				if (i == next_save) {
+					ref_re = re;
+					ref_im = im;
+					next_save *= 2;
+				}
+			}
+		}
+		record_lanes(out, active, max_steps);
+	}
+	return saved + row_scalar(start, step, first + k * stride, stride, count - k, c, max_steps,
+		tolerance, iterations + k, orbits ? orbits + 2 * k : NULL);
+}
+
+__attribute__((target("avx512f")))
+static long row_avx512_float(my_complex start, double const step, int const first, int const stride,
+	int const count, my_complex const c, int const max_steps, double const tolerance, int* const iterations,
+	float* const orbits) {
+	__m512 const c_re = _mm512_set1_ps(c.re), c_im = _mm512_set1_ps(c.im), four = _mm512_set1_ps(4.0f);
+	enum { lanes = 16, all = (1 << lanes) - 1 };
+
+	__m512 const tol2 = _mm512_set1_ps(tolerance * tolerance);
+	long saved = 0;
+
+	int k = 0;
+	for (; k + lanes <= count; k += lanes) {
+		int* const out = iterations + k;
+		float first_re[lanes];
+		for (int l = 0; l < lanes; ++l) {
+			first_re[l] = start.re + (first + (k + l) * stride) * step;
+		}
+		__m512 re = _mm512_loadu_ps(first_re);
+		__m512 im = _mm512_set1_ps(start.im);
+		__m512 re2 = _mm512_mul_ps(re, re), im2 = _mm512_mul_ps(im, im);
+
+		unsigned escaped = _mm512_cmp_ps_mask(_mm512_add_ps(re2, im2), four, _CMP_GE_OQ);
+		record_lanes(out, escaped, 0);
+		unsigned active = all & ~escaped;
+		__m512 ref_re = re, ref_im = im;
+		int next_save = 1;
+
+		for (int i = 1; i <= max_steps && active; ++i) {
+			escaped = _mm512_mask_cmp_ps_mask(active, _mm512_add_ps(re2, im2), four, _CMP_GE_OQ);
+			record_lanes(out, escaped, i);
+			active &= ~escaped;
+			if (orbits && i == max_steps) {
+				float z_re[lanes], z_im[lanes];
+				_mm512_storeu_ps(z_re, re);
+				_mm512_storeu_ps(z_im, im);
+				record_orbits_float(orbits + 2 * k, active, z_re, z_im);
+			}
+
+			__m512 const t = _mm512_mul_ps(re, im);
+			im = _mm512_add_ps(_mm512_add_ps(t, t), c_im);
+			re = _mm512_add_ps(_mm512_sub_ps(re2, im2), c_re);
+			re2 = _mm512_mul_ps(re, re);
+			im2 = _mm512_mul_ps(im, im);
+
+			if (tolerance > 0.0) {
+				__m512 const d_re = _mm512_sub_ps(re, ref_re), d_im = _mm512_sub_ps(im, ref_im);
+				__m512 const d2 = _mm512_add_ps(_mm512_mul_ps(d_re, d_re), _mm512_mul_ps(d_im, d_im));
+				unsigned const periodic = _mm512_mask_cmp_ps_mask(active, d2, tol2, _CMP_LT_OQ);
+				saved += record_periodic(out, periodic, i, max_steps);
+				active &= ~periodic;
+				if (i == next_save) {
+					ref_re = re;
+					ref_im = im;
+					next_save *= 2;
+				}
+			}
+		}
+		record_lanes(out, active, max_steps);
+	}
+	return saved + row_scalar_float(start, step, first + k * stride, stride, count - k, c, max_steps,
+		tolerance, iterations + k, orbits ? orbits + 2 * k : NULL);
+}
+
+/* Resumes four points per vector. Unlike row kernels, lanes start from arbitrary stored
+ orbits, otherwise the loop is the same as in row_avx2. */
+__attribute__((target("avx2")))
+static long resume_avx2(float* const orbits, int const count, my_complex const c, int const from,
+	int const max_steps, double const tolerance, int* const iterations) {
+	__m256d const c_re = _mm256_set1_pd(c.re), c_im = _mm256_set1_pd(c.im);
+	__m256d const four = _mm256_set1_pd(4.0);
+	enum { lanes = 4, all = (1 << lanes) - 1 };
+
+	__m256d const tol2 = _mm256_set1_pd(tolerance * tolerance);
+	long saved = 0;
+
+	int k = 0;
+	for (; k + lanes <= count; k += lanes) {
+		int* const out = iterations + k;
+		double z_re[lanes], z_im[lanes];
+		for (int l = 0; l < lanes; ++l) {
+			z_re[l] = orbits[2 * (k + l)];
+			z_im[l] = orbits[2 * (k + l) + 1];
+		}
+		__m256d re = _mm256_loadu_pd(z_re), im = _mm256_loadu_pd(z_im);
+		__m256d re2 = _mm256_mul_pd(re, re), im2 = _mm256_mul_pd(im, im);
+
+		unsigned active = all;
+		__m256d ref_re = re, ref_im = im;
+		int next_save = from, span = 1;
+
+		for (int i = from; i <= max_steps && active; ++i) {
+			unsigned const escaped = active
+				& _mm256_movemask_pd(_mm256_cmp_pd(_mm256_add_pd(re2, im2), four, _CMP_GE_OQ));
+			record_lanes(out, escaped, i);
+			active &= ~escaped;
+			if (i == max_steps) {
+				_mm256_storeu_pd(z_re, re);
+				_mm256_storeu_pd(z_im, im);
+				record_orbits(orbits + 2 * k, active, z_re, z_im);
+			}
+
+			__m256d const t = _mm256_mul_pd(re, im);
+			im = _mm256_add_pd(c_im, _mm256_add_pd(t, t));
+			re = _mm256_add_pd(c_re, _mm256_sub_pd(re2, im2));
+			re2 = _mm256_mul_pd(re, re);
+			im2 = _mm256_mul_pd(im, im);
+
+			if (tolerance > 0.0) {
+				__m256d const d_re = _mm256_sub_pd(re, ref_re), d_im = _mm256_sub_pd(im, ref_im);
+				__m256d const d2 = _mm256_add_pd(_mm256_mul_pd(d_re, d_re), _mm256_mul_pd(d_im, d_im));
+				unsigned const periodic = active & _mm256_movemask_pd(_mm256_cmp_pd(d2, tol2, _CMP_LT_OQ));
+				saved += record_periodic(out, periodic, i, max_steps);
+				active &= ~periodic;
+				if (i == next_save) {
+					ref_re = re;
+					ref_im = im;
+					next_save += span;
+					span *= 2;
+				}
+			}
+		}
+		record_lanes(out, active, max_steps);
+	}
+	return saved + resume_scalar(orbits + 2 * k, count - k, c, from, max_steps, tolerance, iterations + k);
+}
+
+/* Vector double-double arithmetic, lane by lane the same operations as the scalar one.
+ Needs FMA, which all CPUs with AVX2 (and AVX-512) supported here provide. */
+typedef struct dd_avx2 {
+	__m256d hi, lo;
+} dd_avx2;
+
+__attribute__((target("avx2,fma")))
+static inline dd_avx2 two_sum_avx2(__m256d const a, __m256d const b) {
+	__m256d const s = _mm256_add_pd(a, b), v = _mm256_sub_pd(s, a);
+	dd_avx2 const result = { s, _mm256_add_pd(_mm256_sub_pd(a, _mm256_sub_pd(s, v)), _mm256_sub_pd(b, v)) };
+	return result;
+}
+
+__attribute__((target("avx2,fma")))
+static inline dd_avx2 quick_two_sum_avx2(__m256d const a, __m256d const b) {
+	__m256d const s = _mm256_add_pd(a, b);
+	dd_avx2 const result = { s, _mm256_sub_pd(b, _mm256_sub_pd(s, a)) };
+	return result;
+}
+
+__attribute__((target("avx2,fma")))
+static inline dd_avx2 dd_add_avx2(dd_avx2 const a, dd_avx2 const b) {
+	dd_avx2 s = two_sum_avx2(a.hi, b.hi);
+	dd_avx2 const t = two_sum_avx2(a.lo, b.lo);
+	s = quick_two_sum_avx2(s.hi, _mm256_add_pd(s.lo, t.hi));
+	return quick_two_sum_avx2(s.hi, _mm256_add_pd(s.lo, t.lo));
+}
+
+__attribute__((target("avx2,fma")))
+static inline dd_avx2 dd_mul_avx2(dd_avx2 const a, dd_avx2 const b) {
+	__m256d const p = _mm256_mul_pd(a.hi, b.hi);
+	__m256d const e = _mm256_fmsub_pd(a.hi, b.hi, p);
+	__m256d const cross = _mm256_add_pd(_mm256_mul_pd(a.hi, b.lo), _mm256_mul_pd(a.lo, b.hi));
+	return quick_two_sum_avx2(p, _mm256_add_pd(e, cross));
+}
+
+__attribute__((target("avx2,fma")))
+static void row_avx2_dd(my_complex const start_hi, my_complex const start_lo, double const step,
+	int const first, int const stride, int const count, my_complex const c, int const max_steps,
+	int* const iterations) {
+	__m256d const zero = _mm256_setzero_pd(), four = _mm256_set1_pd(4.0), vstep = _mm256_set1_pd(step);
+	dd_avx2 const c_re = { _mm256_set1_pd(c.re), zero }, c_im = { _mm256_set1_pd(c.im), zero };
+	dd_avx2 const start_re = { _mm256_set1_pd(start_hi.re), _mm256_set1_pd(start_lo.re) };
+	dd_avx2 const start_im = { _mm256_set1_pd(start_hi.im), _mm256_set1_pd(start_lo.im) };
+	__m256d const lane_offsets = _mm256_set_pd(3 * stride, 2 * stride, stride, 0.0);
+	enum { lanes = 4, all = (1 << lanes) - 1 };
+
+	int k = 0;
+	for (; k + lanes <= count; k += lanes) {
+		int* const out = iterations + k;
+		__m256d const index = _mm256_add_pd(_mm256_set1_pd(first + k * stride), lane_offsets);
+		__m256d const offset = _mm256_mul_pd(index, vstep);
+		dd_avx2 const delta = { offset, _mm256_fmsub_pd(index, vstep, offset) };
+		dd_avx2 re = dd_add_avx2(start_re, delta), im = start_im;
+
+		__m256d magnitude = _mm256_add_pd(_mm256_mul_pd(re.hi, re.hi), _mm256_mul_pd(im.hi, im.hi));
+		unsigned escaped = _mm256_movemask_pd(_mm256_cmp_pd(magnitude, four, _CMP_GE_OQ));
+		record_lanes(out, escaped, 0);
+		unsigned active = all & ~escaped;
+
+		for (int i = 1; i <= max_steps && active; ++i) {
+			magnitude = _mm256_add_pd(_mm256_mul_pd(re.hi, re.hi), _mm256_mul_pd(im.hi, im.hi));
+			escaped = active & _mm256_movemask_pd(_mm256_cmp_pd(magnitude, four, _CMP_GE_OQ));
+			record_lanes(out, escaped, i);
+			active &= ~escaped;
+
+			dd_avx2 const t = dd_mul_avx2(re, im);
+			dd_avx2 const twice = { _mm256_add_pd(t.hi, t.hi), _mm256_add_pd(t.lo, t.lo) };
+			dd_avx2 const im2 = dd_mul_avx2(im, im);
+			dd_avx2 const minus_im2 = { _mm256_sub_pd(zero, im2.hi), _mm256_sub_pd(zero, im2.lo) };
+			re = dd_add_avx2(dd_add_avx2(dd_mul_avx2(re, re), minus_im2), c_re);
+			im = dd_add_avx2(twice, c_im);
+		}
+		record_lanes(out, active, max_steps);
+	}
+	row_scalar_dd(start_hi, start_lo, step, first + k * stride, stride, count - k, c, max_steps, iterations + k);
+}
+
+typedef struct dd_avx512 {
+	__m512d hi, lo;
+} dd_avx512;
+
+__attribute__((target("avx512f")))
+static inline dd_avx512 two_sum_avx512(__m512d const a, __m512d const b) {
+	__m512d const s = _mm512_add_pd(a, b), v = _mm512_sub_pd(s, a);
+	dd_avx512 const result = { s, _mm512_add_pd(_mm512_sub_pd(a, _mm512_sub_pd(s, v)), _mm512_sub_pd(b, v)) };
+	return result;
+}
+
+__attribute__((target("avx512f")))
+static inline dd_avx512 quick_two_sum_avx512(__m512d const a, __m512d const b) {
+	__m512d const s = _mm512_add_pd(a, b);
+	dd_avx512 const result = { s, _mm512_sub_pd(b, _mm512_sub_pd(s, a)) };
+	return result;
+}
+
+__attribute__((target("avx512f")))
+static inline dd_avx512 dd_add_avx512(dd_avx512 const a, dd_avx512 const b) {
+	dd_avx512 s = two_sum_avx512(a.hi, b.hi);
+	dd_avx512 const t = two_sum_avx512(a.lo, b.lo);
+	s = quick_two_sum_avx512(s.hi, _mm512_add_pd(s.lo, t.hi));
+	return quick_two_sum_avx512(s.hi, _mm512_add_pd(s.lo, t.lo));
+}
+
+__attribute__((target("avx512f")))
+static inline dd_avx512 dd_mul_avx512(dd_avx512 const a, dd_avx512 const b) {
+	__m512d const p = _mm512_mul_pd(a.hi, b.hi);
+	__m512d const e = _mm512_fmsub_pd(a.hi, b.hi, p);
+	__m512d const cross = _mm512_add_pd(_mm512_mul_pd(a.hi, b.lo), _mm512_mul_pd(a.lo, b.hi));
+	return quick_two_sum_avx512(p, _mm512_add_pd(e, cross));
+}
+
+__attribute__((target("avx512f")))
+static void row_avx512_dd(my_complex const start_hi, my_complex const start_lo, double const step,
+	int const first, int const stride, int const count, my_complex const c, int const max_steps,
+	int* const iterations) {
+	__m512d const zero = _mm512_setzero_pd(), four = _mm512_set1_pd(4.0), vstep = _mm512_set1_pd(step);
+	dd_avx512 const c_re = { _mm512_set1_pd(c.re), zero }, c_im = { _mm512_set1_pd(c.im), zero };
+	dd_avx512 const start_re = { _mm512_set1_pd(start_hi.re), _mm512_set1_pd(start_lo.re) };
+	dd_avx512 const start_im = { _mm512_set1_pd(start_hi.im), _mm512_set1_pd(start_lo.im) };
+	__m512d const lane_offsets = _mm512_set_pd(7 * stride, 6 * stride, 5 * stride, 4 * stride,
+		3 * stride, 2 * stride, stride, 0.0);
+	enum { lanes = 8, all = (1 << lanes) - 1 };
+
+	int k = 0;
+	for (; k + lanes <= count; k += lanes) {
+		int* const out = iterations + k;
+		__m512d const index = _mm512_add_pd(_mm512_set1_pd(first + k * stride), lane_offsets);
+		__m512d const offset = _mm512_mul_pd(index, vstep);
+		dd_avx512 const delta = { offset, _mm512_fmsub_pd(index, vstep, offset) };
+		dd_avx512 re = dd_add_avx512(start_re, delta), im = start_im;
+
+		__m512d magnitude = _mm512_add_pd(_mm512_mul_pd(re.hi, re.hi), _mm512_mul_pd(im.hi, im.hi));
+		unsigned escaped = _mm512_cmp_pd_mask(magnitude, four, _CMP_GE_OQ);
+		record_lanes(out, escaped, 0);
+		unsigned active = all & ~escaped;
+
+		for (int i = 1; i <= max_steps && active; ++i) {
+			magnitude = _mm512_add_pd(_mm512_mul_pd(re.hi, re.hi), _mm512_mul_pd(im.hi, im.hi));
+			escaped = _mm512_mask_cmp_pd_mask(active, magnitude, four, _CMP_GE_OQ);
+			record_lanes(out, escaped, i);
+			active &= ~escaped;
+
+			dd_avx512 const t = dd_mul_avx512(re, im);
+			dd_avx512 const twice = { _mm512_add_pd(t.hi, t.hi), _mm512_add_pd(t.lo, t.lo) };
+			dd_avx512 const im2 = dd_mul_avx512(im, im);
+			dd_avx512 const minus_im2 = { _mm512_sub_pd(zero, im2.hi), _mm512_sub_pd(zero, im2.lo) };
+			re = dd_add_avx512(dd_add_avx512(dd_mul_avx512(re, re), minus_im2), c_re);
+			im = dd_add_avx512(twice, c_im);
+		}
+		record_lanes(out, active, max_steps);
+	}
+	row_scalar_dd(start_hi, start_lo, step, first + k * stride, stride, count - k, c, max_steps, iterations + k);
+}
+
+#endif
+
+static struct {
+	char const* name;
+	row_kernel row, row_float;
+	resume_kernel resume;
+	double_double_kernel row_dd;
+} const kernels[kernel_count] = {
+	[kernel_scalar] = { "scalar", row_scalar, row_scalar_float, resume_scalar, row_scalar_dd },
+#ifdef BATCH_X86
+	//SSE2 has no fused multiply-add, which cheap double-double products rely on
+	[kernel_sse2] = { "sse2", row_sse2, row_sse2_float, resume_scalar, row_scalar_dd },
+	[kernel_avx2] = { "avx2", row_avx2, row_avx2_float, resume_avx2, row_avx2_dd },
+	[kernel_avx512] = { "avx512", row_avx512, row_avx512_float, resume_avx2, row_avx512_dd },
+#endif
+};
+
+static enum batch_kernel selected = kernel_scalar;
+
+static bool kernel_supported(enum batch_kernel const k) {
+	assert(k >= 0 && k < kernel_count);
+#ifdef BATCH_X86
+	__builtin_cpu_init();
+	switch (k) {
+	case kernel_scalar: return true;
+	case kernel_sse2: return __builtin_cpu_supports("sse2");
+	case kernel_avx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	case kernel_avx512: return __builtin_cpu_supports("avx512f");
+	default: return false;
+	}
+#else
+	return k == kernel_scalar;
+#endif
+}
+
+void batch_select_kernel() {
+	for (int k = kernel_count - 1; k >= 0; --k) {
+		if (kernel_supported(k)) {
+			selected = k;
+			return;
+		}
+	}
+}
+
+bool batch_set_kernel(enum batch_kernel const k) {
+	if (!kernel_supported(k)) {
+		return false;
+	}
+	selected = k;
+	return true;
+}
+
+enum batch_kernel batch_get_kernel() {
+	return selected;
+}
+
+char const* batch_kernel_name(enum batch_kernel const k) {
+	assert(k >= 0 && k < kernel_count);
+	return kernels[k].name;
+}
+
+long convergence_test_row(my_complex const start, double const step, int const first,
+	int const stride, int const count, my_complex const c, int const max_steps, double const tolerance,
+	int* const iterations, float* const orbits) {
+	return kernels[selected].row(start, step, first, stride, count, c, max_steps, tolerance, iterations,
+		orbits);
+}
+
+long convergence_test_row_float(my_complex const start, double const step, int const first,
+	int const stride, int const count, my_complex const c, int const max_steps, double const tolerance,
+	int* const iterations, float* const orbits) {
+	return kernels[selected].row_float(start, step, first, stride, count, c, max_steps, tolerance,
+		iterations, orbits);
+}
+
+long convergence_resume_row(float* const orbits, int const count, my_complex const c, int const from,
+	int const max_steps, double const tolerance, int* const iterations) {
+	return kernels[selected].resume(orbits, count, c, from, max_steps, tolerance, iterations);
+}
+
+void convergence_test_row_dd(my_complex const start_hi, my_complex const start_lo, double const step,
+	int const first, int const stride, int const count, my_complex const c, int const max_steps,
+	int* const iterations) {
+	kernels[selected].row_dd(start_hi, start_lo, step, first, stride, count, c, max_steps, iterations);
+}
+
+bool batch_float_sufficient(double const spacing) {
+	//Points |z| < 2 are stored with absolute error around 2 * FLT_EPSILON. Demand a few
+	//hundreds of these between neighbouring pixels, so that rounding does not merge them.
+	return spacing >= 512 * FLT_EPSILON;
+}
+
+bool batch_double_sufficient(double const spacing) {
+	//Same margin as batch_float_sufficient, deeper views need double-double
+	return spacing >= 512 * DBL_EPSILON;
+}
+
+bool batch_double_double_sufficient(double const spacing) {
+	//Double-double carries about twice the bits of double, deeper views have to be perturbed
+	return spacing >= 512 * DBL_EPSILON * DBL_EPSILON;
+}
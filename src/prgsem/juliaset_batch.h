@@ -0,0 +1,72 @@
+#ifndef JULIA_BATCH_H
+#define JULIA_BATCH_H
+
+#include <stdbool.h>
+#include "juliaset.h"
+
+//Instruction set used to evaluate whole rows of points at once
+enum batch_kernel {
+	kernel_scalar, //Plain C, one point at a time
+	kernel_sse2, //2 doubles or 4 floats per vector
+	kernel_avx2, //4 doubles or 8 floats per vector
+	kernel_avx512, //8 doubles or 16 floats per vector
+	kernel_count
+};
+
+/* Query CPUID and select the widest kernel this machine can run. Call once at startup. */
+void batch_select_kernel();
+
+/* Force given kernel. Returns false (and keeps the current one) if the CPU does not support it. */
+bool batch_set_kernel(enum batch_kernel k);
+
+//Returns the kernel currently used by convergence_test_row
+enum batch_kernel batch_get_kernel();
+
+//Human readable name of the kernel, e.g. "avx2"
+char const* batch_kernel_name(enum batch_kernel k);
+
+/* Examine convergence of 'count' points lying in a single row of the complex plane.
+ k-th point is { start.re + (first + k * stride) * step, start.im }, so that segments and
+ sparse samples of a row evaluate exactly the same points as the whole row. The k-th result
+ stored to 'iterations' is exactly the value convergence_test would return for that point.
+ With positive 'tolerance' periodic orbits are detected as by convergence_test_periodic.
+ Unless 'orbits' is NULL, z examined at step max_steps by points which did not escape is stored
+ to orbits[2k] and orbits[2k + 1], other entries are left untouched (see convergence_resume).
+ Returns number of iterations skipped thanks to periodicity checking. */
+long convergence_test_row(my_complex start, double step, int first, int stride, int count, my_complex c,
+	int max_steps, double tolerance, int* iterations, float* orbits);
+
+/* Same as convergence_test_row, but iterates in single precision, which doubles
+ the number of lanes per vector. Results may differ slightly from the double precision
+ kernel, use only when batch_float_sufficient allows it. */
+long convergence_test_row_float(my_complex start, double step, int first, int stride, int count, my_complex c,
+	int max_steps, double tolerance, int* iterations, float* orbits);
+
+/* Continue iterating 'count' points, which did not escape within 'from' steps. orbits[2k] and
+ orbits[2k + 1] hold z examined at step 'from' by the k-th point as stored by convergence_test_row
+ and are updated the same way for further resuming. The k-th result stored to 'iterations' is
+ the count convergence_test would give for 'max_steps' (up to rounding of the stored z).
+ Returns number of iterations skipped thanks to periodicity checking. */
+long convergence_resume_row(float* orbits, int count, my_complex c, int from, int max_steps,
+	double tolerance, int* iterations);
+
+/* Double-double (about 106 bits) counterpart of convergence_test_row for views too deep for
+ doubles. The start of the row is given as the unevaluated sum start_hi + start_lo, the k-th
+ point is start + (first + k * stride) * step evaluated exactly. Results are the counts
+ convergence_test would give if it iterated in double-double. Periodicity checking and
+ orbits for resuming are not supported. Vector kernels need FMA. */
+void convergence_test_row_dd(my_complex start_hi, my_complex start_lo, double step, int first, int stride,
+	int count, my_complex c, int max_steps, int* iterations);
+
+/* Returns true iff neighbouring pixels 'spacing' apart are still resolved well
+ enough by single precision arithmetic (i.e. the view is zoomed out enough). */
+bool batch_float_sufficient(double spacing);
+
+/* Returns true iff neighbouring pixels 'spacing' apart are resolved by double precision,
+ i.e. convergence_test_row can still be used. */
+bool batch_double_sufficient(double spacing);
+
+//Returns true iff convergence_test_row_dd still resolves pixels 'spacing' apart
+bool batch_double_double_sufficient(double spacing);
+
+#endif
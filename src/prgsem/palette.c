@@ -0,0 +1,101 @@
+
+#include "palette.h"
+#include "juliaset.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define PALETTE_X86
+#endif
+
+//Three bytes of rgb per each possible iteration count
+static uint8_t* table = NULL;
+//The same colors padded to four bytes, so that vector gathers can load them
+static uint32_t* padded = NULL;
+static int table_max_steps = -1;
+static bool use_avx2 = false;
+
+bool palette_rebuild(int const max_steps) {
+	assert(max_steps >= 0);
+	if (max_steps == table_max_steps) {
+		return true;
+	}
+
+	uint8_t* const new_table = malloc(3 * (max_steps + 1));
+	uint32_t* const new_padded = malloc(sizeof(uint32_t) * (max_steps + 1));
+	if (!new_table || !new_padded) {
+		fprintf(stderr, "ERROR: Cannot allocate palette for %d colors.\r\n", max_steps + 1);
+		free(new_table);
+		free(new_padded);
+		return false;
+	}
+	for (int i = 0; i <= max_steps; ++i) {
+		new_table[3 * i + 0] = red_component(i, max_steps);
+		new_table[3 * i + 1] = green_component(i, max_steps);
+		new_table[3 * i + 2] = blue_component(i, max_steps);
+		new_padded[i] = 0;
+		memcpy(&new_padded[i], &new_table[3 * i], 3);
+	}
+	free(table);
+	free(padded);
+	table = new_table;
+	padded = new_padded;
+	table_max_steps = max_steps;
+#ifdef PALETTE_X86
+	__builtin_cpu_init();
+	use_avx2 = __builtin_cpu_supports("avx2");
+#endif
+	return true;
+}
+
+void palette_cleanup() {
+	free(table);
+	free(padded);
+	table = NULL;
+	padded = NULL;
+	table_max_steps = -1;
+}
+
+uint8_t const* palette_color(int const iterations) {
+	assert(table && iterations >= 0);
+	return table + 3 * (iterations < table_max_steps ? iterations : table_max_steps);
+}
+
+#ifdef PALETTE_X86
+/* Colors eight pixels per iteration by gathering their padded colors and packing them
+ to 24 bytes. Returns the number of pixels colored, the caller finishes the rest. */
+__attribute__((target("avx2")))
+static int color_counts_avx2(uint16_t const* const counts, int const count, uint8_t* const rgb) {
+	__m256i const limit = _mm256_set1_epi32(table_max_steps);
+	//Moves three color bytes of each lane to the low twelve bytes of each half
+	__m256i const pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	int i = 0;
+	//Each iteration writes 28 bytes (the last four are garbage overwritten later), stay within 'rgb'
+	for (; i + 10 <= count; i += 8) {
+		__m256i index = _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i const*)(counts + i)));
+		index = _mm256_min_epu32(index, limit);
+		__m256i const colors = _mm256_shuffle_epi8(_mm256_i32gather_epi32((int const*)padded, index, 4), pack);
+		_mm_storeu_si128((__m128i*)(rgb + 3 * i), _mm256_castsi256_si128(colors));
+		_mm_storeu_si128((__m128i*)(rgb + 3 * i + 12), _mm256_extracti128_si256(colors, 1));
+	}
+	return i;
+}
+#endif
+
+void palette_color_counts(uint16_t const* const counts, int const count, uint8_t* const rgb) {
+	assert(table);
+	int i = 0;
+#ifdef PALETTE_X86
+	if (use_avx2) {
+		i = color_counts_avx2(counts, count, rgb);
+	}
+#endif
+	for (; i < count; ++i) {
+		memcpy(rgb + 3 * i, palette_color(counts[i]), 3);
+	}
+}
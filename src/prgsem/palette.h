@@ -0,0 +1,22 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Recompute the table of colors for iteration counts 0..max_steps. Must be called whenever
+ the precision changes. Returns false if memory for the table cannot be allocated. */
+bool palette_rebuild(int max_steps);
+
+/* Free the table. */
+void palette_cleanup();
+
+/* Returns pointer to three bytes (r, g, b) corresponding to given iteration count.
+ Counts above max_steps are treated as max_steps. */
+uint8_t const* palette_color(int iterations);
+
+/* Colors 'count' consecutive pixels. Reads their iteration counts from 'counts'
+ and writes 3 * count bytes of rgb data to 'rgb'. Uses AVX2 gathers when available. */
+void palette_color_counts(uint16_t const* counts, int count, uint8_t* rgb);
+
+#endif
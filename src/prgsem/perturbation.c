@@ -0,0 +1,218 @@
+
+#include "perturbation.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+mp_real mp_from_double(double x) {
+	mp_real result;
+	result.negative = x < 0;
+	x = fabs(x);
+	for (int i = 0; i < MP_LIMBS; ++i) {
+		double const limb = floor(x);
+		result.limb[i] = limb;
+		x = ldexp(x - limb, 32);
+	}
+	return result;
+}
+
+double mp_to_double(mp_real x) {
+	double result = 0.0;
+	for (int i = MP_LIMBS - 1; i >= 0; --i) {
+		result = ldexp(result, -32) + x.limb[i];
+	}
+	return x.negative ? -result : result;
+}
+
+void mp_to_double_double(mp_real x, double* hi, double* lo) {
+	*hi = mp_to_double(x);
+	*lo = mp_to_double(mp_sub(x, mp_from_double(*hi)));
+}
+
+mp_complex mp_complex_from(my_complex z) {
+	mp_complex const result = { mp_from_double(z.re), mp_from_double(z.im) };
+	return result;
+}
+
+my_complex mp_complex_to(mp_complex z) {
+	my_complex const result = { mp_to_double(z.re), mp_to_double(z.im) };
+	return result;
+}
+
+static int compare_magnitudes(mp_real const* a, mp_real const* b) {
+	for (int i = 0; i < MP_LIMBS; ++i) {
+		if (a->limb[i] != b->limb[i]) {
+			return a->limb[i] < b->limb[i] ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+static bool mp_equal(mp_real const* a, mp_real const* b) {
+	return a->negative == b->negative && !compare_magnitudes(a, b);
+}
+
+//Magnitude of the result is |a| + |b|, sign is left to the caller
+static mp_real add_magnitudes(mp_real const* a, mp_real const* b) {
+	mp_real result;
+	uint64_t carry = 0;
+	for (int i = MP_LIMBS - 1; i >= 0; --i) {
+		uint64_t const sum = (uint64_t)a->limb[i] + b->limb[i] + carry;
+		result.limb[i] = sum;
+		carry = sum >> 32;
+	}
+	return result;
+}
+
+//Magnitude of the result is |a| - |b|, requires |a| >= |b|
+static mp_real subtract_magnitudes(mp_real const* a, mp_real const* b) {
+	mp_real result;
+	int64_t borrow = 0;
+	for (int i = MP_LIMBS - 1; i >= 0; --i) {
+		int64_t const difference = (int64_t)a->limb[i] - b->limb[i] - borrow;
+		result.limb[i] = difference;
+		borrow = difference < 0;
+	}
+	return result;
+}
+
+mp_real mp_add(mp_real a, mp_real b) {
+	mp_real result;
+	if (a.negative == b.negative) {
+		result = add_magnitudes(&a, &b);
+		result.negative = a.negative;
+	}
+	else if (compare_magnitudes(&a, &b) >= 0) {
+		result = subtract_magnitudes(&a, &b);
+		result.negative = a.negative;
+	}
+	else {
+		result = subtract_magnitudes(&b, &a);
+		result.negative = b.negative;
+	}
+	return result;
+}
+
+mp_real mp_sub(mp_real a, mp_real b) {
+	b.negative = !b.negative;
+	return mp_add(a, b);
+}
+
+mp_real mp_mul(mp_real a, mp_real b) {
+	//Schoolbook multiplication, product of limbs i and j is weighted by t[i + j + 1]
+	uint32_t t[2 * MP_LIMBS];
+	memset(t, 0, sizeof t);
+	for (int i = MP_LIMBS - 1; i >= 0; --i) {
+		uint64_t carry = 0;
+		for (int j = MP_LIMBS - 1; j >= 0; --j) {
+			uint64_t const product = (uint64_t)a.limb[i] * b.limb[j] + t[i + j + 1] + carry;
+			t[i + j + 1] = product;
+			carry = product >> 32;
+		}
+		t[i] = carry;
+	}
+	mp_real result;
+	memcpy(result.limb, t + 1, sizeof result.limb); //t[0] would only hold integer parts above 2^32
+	result.negative = a.negative != b.negative;
+	return result;
+}
+
+//Next element of the orbit, z^2 + c
+static mp_complex step(mp_complex z, mp_complex c) {
+	mp_real const product = mp_mul(z.re, z.im);
+	mp_complex const result = {
+		mp_add(mp_sub(mp_mul(z.re, z.re), mp_mul(z.im, z.im)), c.re),
+		mp_add(mp_add(product, product), c.im)
+	};
+	return result;
+}
+
+/* Stores the orbit of 'z' rounded to doubles until it escapes or max_steps + 1 elements
+ are known. Returns the number of elements stored to 'orbit'. */
+static int compute_orbit(mp_complex z, mp_complex c, int max_steps, double* orbit) {
+	int length = 0;
+	while (length <= max_steps) {
+		my_complex const rounded = mp_complex_to(z);
+		orbit[2 * length] = rounded.re;
+		orbit[2 * length + 1] = rounded.im;
+		++length;
+		if (rounded.re * rounded.re + rounded.im * rounded.im >= 4.0) {
+			break;
+		}
+		z = step(z, c);
+	}
+	return length;
+}
+
+bool perturbation_prepare(struct perturbation_reference* r, mp_complex center, my_complex c, int max_steps) {
+	if (r->orbit && r->max_steps == max_steps && r->c.re == c.re && r->c.im == c.im
+		&& mp_equal(&r->center.re, &center.re) && mp_equal(&r->center.im, &center.im)) {
+		return true;
+	}
+	perturbation_free(r);
+	r->orbit = malloc(2 * sizeof(double) * (max_steps + 1));
+	r->critical = malloc(2 * sizeof(double) * (max_steps + 1));
+	if (!r->orbit || !r->critical) {
+		fprintf(stderr, "ERROR: Cannot allocate reference orbits.\r\n");
+		perturbation_free(r);
+		return false;
+	}
+	r->center = center;
+	r->c = c;
+	r->max_steps = max_steps;
+	mp_complex const mp_c = mp_complex_from(c);
+	r->length = compute_orbit(center, mp_c, max_steps, r->orbit);
+	my_complex const zero = { 0.0, 0.0 };
+	r->critical_length = compute_orbit(mp_complex_from(zero), mp_c, max_steps, r->critical);
+	return true;
+}
+
+void perturbation_free(struct perturbation_reference* r) {
+	free(r->orbit);
+	free(r->critical);
+	r->orbit = r->critical = NULL;
+	r->length = r->critical_length = 0;
+}
+
+long perturbation_test_row(struct perturbation_reference const* r, my_complex offset, double step,
+	int first, int stride, int count, int max_steps, int* iterations) {
+	long rebased = 0;
+	for (int k = 0; k < count; ++k) {
+		double const* reference = r->orbit;
+		int length = r->length, m = 0;
+		double dr = offset.re + (first + k * stride) * step, di = offset.im;
+		double const z0r = reference[0] + dr, z0i = reference[1] + di;
+		if (z0r * z0r + z0i * z0i >= 4.0) {
+			iterations[k] = 0;
+			continue;
+		}
+		int result = max_steps;
+		//Same steps as convergence_test, z_{i - 1} = Z_m + d is examined in the i-th one
+		for (int i = 1; i <= max_steps; ++i) {
+			double const zr = reference[2 * m] + dr, zi = reference[2 * m + 1] + di;
+			double const magnitude = zr * zr + zi * zi;
+			if (magnitude >= 4.0) {
+				result = i;
+				break;
+			}
+			if (magnitude < dr * dr + di * di || m + 1 >= length) {
+				//Glitch or end of the reference, continue along the orbit of 0 with d = z
+				reference = r->critical;
+				length = r->critical_length;
+				m = 0;
+				dr = zr;
+				di = zi;
+				++rebased;
+			}
+			double const tr = 2 * reference[2 * m] + dr, ti = 2 * reference[2 * m + 1] + di;
+			double const next_r = tr * dr - ti * di;
+			di = tr * di + ti * dr;
+			dr = next_r;
+			++m;
+		}
+		iterations[k] = result;
+	}
+	return rebased;
+}
@@ -0,0 +1,69 @@
+#ifndef PERTURBATION_H
+#define PERTURBATION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "juliaset.h"
+
+/* Deep zoom by perturbation. A single reference orbit Z_n starting at the center of the view
+ is computed in multiprecision. Every pixel z_0 = Z_0 + d_0 then iterates just its difference
+ d_n = z_n - Z_n in double precision, d_{n+1} = (2 Z_n + d_n) d_n, which stays exact relative
+ to its own (tiny) magnitude. Once the pixel gets closer to zero than to the reference
+ (|z_n| < |d_n|), rounding of d_n would dominate (a glitch). Such pixels are rebased onto
+ the orbit of the critical point 0, i.e. d becomes z_n and the reference restarts. */
+
+//Number of 32-bit limbs of multiprecision numbers, the first holds the integer part.
+//Fractions of 224 bits allow views down to about 1e-60 wide.
+#define MP_LIMBS 8
+
+//Finest spacing of pixels, the center of the view keeps 24 bits of the 224 below it
+#define MP_MIN_SPACING 0x1p-200
+
+//Signed fixed-point number. Integer part has to stay within 16 bits for multiplication.
+typedef struct mp_real {
+	uint32_t limb[MP_LIMBS]; //Magnitude, limb[i] is weighted by 2^(-32 i)
+	bool negative;
+} mp_real;
+
+typedef struct mp_complex {
+	mp_real re, im;
+} mp_complex;
+
+//Exact conversion of doubles (except for bits below 2^(-224)) and rounding back
+mp_real mp_from_double(double x);
+double mp_to_double(mp_real x);
+mp_complex mp_complex_from(my_complex z);
+my_complex mp_complex_to(mp_complex z);
+//Splits x into the unevaluated sum of doubles hi + lo (a double-double)
+void mp_to_double_double(mp_real x, double* hi, double* lo);
+
+mp_real mp_add(mp_real a, mp_real b);
+mp_real mp_sub(mp_real a, mp_real b);
+//Truncates bits below 2^(-224)
+mp_real mp_mul(mp_real a, mp_real b);
+
+//Reference orbits shared by all pixels of a view
+struct perturbation_reference {
+	mp_complex center; //Z_0
+	my_complex c;
+	int max_steps;
+	double* orbit; //Z_0, Z_1, ... rounded to doubles as re, im pairs
+	int length; //Number of Z_n stored, the last one escaped unless there are max_steps + 1 of them
+	double* critical; //Orbit of 0 used after rebasing
+	int critical_length;
+};
+
+/* Compute both orbits for given center, constant and precision. Nothing is recomputed
+ if they are the same as last time. Returns false if memory cannot be allocated. */
+bool perturbation_prepare(struct perturbation_reference* r, mp_complex center, my_complex c, int max_steps);
+
+//Free both orbits
+void perturbation_free(struct perturbation_reference* r);
+
+/* Examine 'count' pixels of a row. k-th of them lies at Z_0 + d_0, where
+ d_0 = { offset.re + (first + k * stride) * step, offset.im }. Results stored to 'iterations'
+ have the same meaning as those of convergence_test. Returns the number of rebased orbits. */
+long perturbation_test_row(struct perturbation_reference const* r, my_complex offset, double step,
+	int first, int stride, int count, int max_steps, int* iterations);
+
+#endif
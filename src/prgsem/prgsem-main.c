@@ -22,6 +22,11 @@
 #include "ringbuffer.h"
 #include "fractal_drawer.h"
 #include "juliaset.h"
+#include "juliaset_batch.h"
+#include "tile_store.h"
+#include "animation.h"
+#include "stream_image.h"
+#include "tiled_image.h"
 
 //How long (in sec) should the program hold off when communication stops.
 //This may occur namely because of disconnect. Program then exits
@@ -40,6 +45,7 @@ char const* const basic_stdin_help = "Basic help:\r\n"
 "s - Start (or possibly resume if it was only interrupted) the computation.\r\n"
 "\t\tImmediatelly draws intermediate results to the screen.\r\n"
 "e - Export to ppm.\r\n"
+"t - Print rendering statistics.\r\n"
 "\r\n"
 "Submenus:\r\n"
 "b - Configure the communication baudrate.\r\n"
@@ -62,7 +68,29 @@ char const* const drawing_config_help = "Drawing configuration.\r\n"
 "\r\n"
 "Chunk selection policy, e.g. by what criteria are unfinished chunks selected for computation:\r\n"
 "    r - Random - simply random...\r\n"
-"    s - Sequential - topmost and then leftmost empty chunk is selected.\r\n";
+"    s - Sequential - topmost and then leftmost empty chunk is selected.\r\n"
+"\r\n"
+"Evaluation of pixels within chunks during local computation:\r\n"
+"    a - All - every pixel is iterated.\r\n"
+"    m - Mariani-Silver - rectangles with uniform border are filled without iterating.\r\n"
+"    o - Progressive - coarse passes at 1/16 and 1/4 resolution are shown first.\r\n"
+"\r\n"
+"Local computation:\r\n"
+"    k - Switch to the next SIMD kernel supported by this CPU.\r\n"
+"    f - Toggle single precision kernels for shallow zooms.\r\n"
+"    c - Toggle periodicity checking (early exit of points inside the set).\r\n"
+"    y - Toggle symmetry (chunks mirrored under z -> -z are copied, not computed).\r\n"
+"    j - Switch number of threads (1, 2, 4... up to number of CPUs; 1 is the reference mode).\r\n"
+"    n - Toggle prefetching of views one move away while idle (on by default).\r\n"
+"    b - Toggle interactive mode (coarser pixels while moving to keep frames within 50 ms).\r\n"
+"\r\n"
+"Precision (maximal number of iterations per pixel):\r\n"
+"    p - Double the precision (pixels which reached the former limit are iterated further).\r\n"
+"    l - Halve the precision (stored iteration counts are just recolored).\r\n"
+"    u - Toggle automatic precision chosen by a preview of each view (p and l turn it off).\r\n"
+"\r\n"
+"Export:\r\n"
+"    x - Switch supersampling of detailed pixels (off, 2x2, 3x3, 4x4 samples per pixel).\r\n";
 
 char const* const free_move_help = "Free move.\r\n"
 "q  return to the main menu\r\n"
@@ -85,8 +113,10 @@ char const* const constant_move_help = "Move constant.\r\n"
 //Default configuration
 
 /*Coefficients by which camera moves and/or zooms the picture. Used as multiplicators.*/
-float const zoom_coefficient = 0.8f;
+double const zoom_coefficient = 0.8;
 float const move_coeeficient = 0.2f;
+//Frame time held by dynamic resolution in the interactive mode (seconds)
+double const interactive_frame_budget = 0.05;
 
 int const default_width = 320;
 int const default_height = 240;
@@ -97,6 +127,10 @@ int const default_chunk_cols = 20;
 my_complex const max_top_left = { -1.6, 1.1 }, max_bot_right = { 1.6, -1.1 };
 my_complex const default_fractal_constant = { 0.0, 0.75 };
 
+//Environment variable naming the directory persisting computed chunks across runs and its size limit in bytes
+char const* const tile_store_variable = "PRGSEM_TILE_STORE";
+size_t const default_tile_store_capacity = 256 << 20;
+
 //Ring buffer containing incoming messages
 queue_t* messages;
 
@@ -243,11 +277,16 @@ void send_abort_request() {
 	message_enqueue(&msg);
 }
 
-void send_message_compute() {
+/* Sends the next chunk to Nucleo. Returns false if no chunk was sent,
+ because all remaining ones were found in the tile cache. */
+bool send_message_compute() {
 	message msg = { .type = MSG_COMPUTE };
-	msg.data.compute = fractal_get_next_chunk();
+	if (!fractal_get_next_chunk(&msg.data.compute)) {
+		return false;
+	}
 	message_calculate_checksum(&msg);
 	message_enqueue(&msg);
+	return true;
 }
 
 void send_connection_confirmation() {
@@ -307,7 +346,8 @@ int redrawing_thread() {
 	for (; !thread_data.quit;) {
 
 		fractal_redraw();
-		usleep(1000 * (1000 / FPS));
+		//Passes of progressive rendering are shown as soon as they are complete
+		fractal_wait_for_update(1000 / FPS);
 	}
 
 	fprintf(stderr, "INFO: Redrawing thread exits.\r\n");
@@ -388,6 +428,97 @@ void poll_drawing_config() {
 		fprintf(stderr, "INFO: Selected %s policy.\r\n", command == 's' ? "sequential" : "random");
 		break;
 
+	case 'a':
+		fractal_set_render_mode(render_full);
+		fprintf(stderr, "INFO: Selected full rendering.\r\n");
+		break;
+	case 'm':
+		fractal_set_render_mode(render_subdivide);
+		fprintf(stderr, "INFO: Selected Mariani-Silver rendering.\r\n");
+		break;
+	case 'o':
+		fractal_set_render_mode(render_progressive);
+		fprintf(stderr, "INFO: Selected progressive rendering.\r\n");
+		break;
+
+	case 'k': {
+		enum batch_kernel next = batch_get_kernel();
+		do {
+			next = (next + 1) % kernel_count;
+		} while (!batch_set_kernel(next));
+		fprintf(stderr, "INFO: Selected %s kernel.\r\n", batch_kernel_name(next));
+		break;
+	}
+	case 'f':
+		fractal_set_single_precision(!fractal_get_single_precision());
+		fprintf(stderr, "INFO: Single precision kernels %s.\r\n"
+			, fractal_get_single_precision() ? "allowed" : "forbidden");
+		break;
+
+	case 'c':
+		fractal_set_periodicity_check(!fractal_get_periodicity_check());
+		fprintf(stderr, "INFO: Periodicity checking %s. Retransmit settings to apply it on Nucleo.\r\n"
+			, fractal_get_periodicity_check() ? "enabled" : "disabled");
+		break;
+
+	case 'j': {
+		int const cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		int const threads = fractal_get_thread_count() >= cpus ? 1 : fractal_get_thread_count() * 2;
+		fractal_set_thread_count(threads < cpus ? threads : cpus);
+		fprintf(stderr, "INFO: Local computation uses %d thread(s).\r\n", fractal_get_thread_count());
+		break;
+	}
+	case 'b':
+		fractal_set_frame_budget(fractal_get_frame_budget() > 0.0 ? 0.0 : interactive_frame_budget);
+		if (fractal_get_frame_budget() > 0.0) {
+			fprintf(stderr, "INFO: Interactive mode, frames are rendered within %.0f ms and refined once you stop.\r\n",
+				fractal_get_frame_budget() * 1e3);
+		}
+		else {
+			fprintf(stderr, "INFO: Interactive mode disabled.\r\n");
+		}
+		break;
+	case 'n':
+		fractal_set_prefetch(!fractal_get_prefetch(), move_coeeficient, zoom_coefficient);
+		fprintf(stderr, "INFO: Prefetching of neighbouring views %s.\r\n", fractal_get_prefetch() ? "enabled" : "disabled");
+		break;
+	case 'u':
+		fractal_set_auto_precision(!fractal_get_auto_precision());
+		fprintf(stderr, "INFO: Automatic precision %s.\r\n", fractal_get_auto_precision() ? "enabled" : "disabled");
+		break;
+	case 'p': case 'l': {
+		int const old = fractal_get_precision();
+		if (fractal_get_auto_precision()) {
+			fractal_set_auto_precision(false);
+			fprintf(stderr, "INFO: Automatic precision disabled.\r\n");
+		}
+		if (!fractal_set_precision(command == 'p' ? 2 * old : (old + 1) / 2)) {
+			break;
+		}
+		fprintf(stderr, "INFO: Precision set to %d iterations.\r\n", fractal_get_precision());
+		if (fractal_get_precision() > UINT8_MAX) {
+			fprintf(stderr, "WARN: Nucleo cannot compute more than %d iterations.\r\n", UINT8_MAX);
+		}
+		if (!fractal_finished()) {
+			fractal_render_async();
+		}
+		break;
+	}
+	case 'x':
+		fractal_set_supersampling(fractal_get_supersampling() % 4 + 1);
+		if (fractal_get_supersampling() == 1) {
+			fprintf(stderr, "INFO: Supersampling of exported pictures disabled.\r\n");
+		}
+		else {
+			fprintf(stderr, "INFO: Detailed pixels of exported pictures are supersampled by %dx%d samples.\r\n",
+				fractal_get_supersampling(), fractal_get_supersampling());
+		}
+		break;
+	case 'y':
+		fractal_set_symmetry(!fractal_get_symmetry());
+		fprintf(stderr, "INFO: Symmetry %s.\r\n", fractal_get_symmetry() ? "exploited" : "ignored");
+		break;
+
 	case 'q':
 		tty_state = tty_basic;
 		fprintf(stderr, "INFO: Returning to basic menu.\r\n");
@@ -399,55 +530,39 @@ void poll_drawing_config() {
 }
 
 //Zoom in or out depending on the op. Simply pushes edges of the visible rectangle 
-//toward or away freom the center of the screen.
+//toward or away freom the center of the screen. The new view is rendered in the background,
+//the render of the previous one is abandoned.
 void zoom(char const op) {
 	assert(op == '+' || op == '-');
-	my_complex const middle = fractal_get_center();
 
-	my_complex top_left = sub(fractal_get_edge(bound_topleft), middle),
-		bot_right = sub(fractal_get_edge(bound_botright), middle);
-
-	float const scalar = op == '+' ? zoom_coefficient : 1 / zoom_coefficient;
-	top_left = scalar_mul(top_left, scalar);
-	bot_right = scalar_mul(bot_right, scalar);
-
-	fractal_set_edge(bound_botright, add(bot_right, middle));
-	fractal_set_edge(bound_topleft, add(top_left, middle));
-	fractal_set_all_chunks_unseen();
-	fractal_compute_locally();
+	double const scalar = op == '+' ? zoom_coefficient : 1 / zoom_coefficient;
+	double const reused = fractal_zoom(scalar);
+	fractal_render_async();
+	fprintf(stderr, "INFO: %.1f %% of pixels reused from the previous picture.\r\n", 100.0 * reused);
 }
 
-//Moves edges of the visible rectangle and thus translates our view of the complex plane
+//Moves edges of the visible rectangle and thus translates our view of the complex plane.
+//The step is rounded to whole pixels, so that the rest of the picture can be reused.
 void move(char const op) {
 
-	my_complex const visible = sub(fractal_get_edge(bound_topleft),
-		fractal_get_edge(bound_botright));
-
-	my_complex dx = { fabs(visible.re), 0 };
-	my_complex dy = { 0, fabs(visible.im) };
-	dx = scalar_mul(dx, move_coeeficient);
-	dy = scalar_mul(dy, move_coeeficient);
+	int const dx = lround(fractal_get_width() * move_coeeficient);
+	int const dy = lround(fractal_get_height() * move_coeeficient);
 
-	my_complex displacement = { 0.0f,0.0f };
 	switch (op) {
 	case 'w':
-		displacement = dy;
+		fractal_pan(0, -dy);
 		break;
 	case 's':
-		displacement = negate(dy);
+		fractal_pan(0, dy);
 		break;
 	case 'a':
-		displacement = negate(dx);
+		fractal_pan(-dx, 0);
 		break;
 	case 'd':
-		displacement = dx;
+		fractal_pan(dx, 0);
 		break;
 	}
-
-	fractal_set_edge(bound_topleft, add(fractal_get_edge(bound_topleft), displacement));
-	fractal_set_edge(bound_botright, add(fractal_get_edge(bound_botright), displacement));
-	fractal_set_all_chunks_unseen();
-	fractal_compute_locally();
+	fractal_render_async();
 }
 
 /* Encapsulates reading from stdin when the camera is flying free above the complex plane. */
@@ -466,7 +581,7 @@ void poll_free_move() {
 		fractal_set_edge(bound_botright, max_bot_right);
 		fractal_set_all_chunks_unseen();
 		fractal_clear_buffer();
-		fractal_compute_locally();
+		fractal_render_async();
 		break;
 	case 'q':
 		tty_state = tty_basic;
@@ -505,7 +620,7 @@ void poll_move_constant() {
 		fprintf(stderr, "Restoring default constant.\r\n");
 		fractal_set_constant(default_fractal_constant);
 		fractal_set_all_chunks_unseen();
-		fractal_compute_locally();
+		fractal_render_async();
 		break;
 	case 'q':
 		tty_state = tty_basic;
@@ -535,7 +650,7 @@ void poll_move_constant() {
 
 		fractal_set_constant(add(fractal_get_constant(), displacement));
 		fractal_set_all_chunks_unseen();
-		fractal_compute_locally();
+		fractal_render_async();
 		break;
 	}
 	default:
@@ -610,14 +725,21 @@ void poll_stdin() {
 			fprintf(stderr, "WARN: Nothing to do. You must first reset chunks.\r\n");
 		}
 		else {
-			fprintf(stderr, "INFO : Computing fractal locally.\r\n");
-			fractal_compute_locally();
-			fprintf(stderr, "INFO: Done.\r\n");
+			fprintf(stderr, "INFO: Computing fractal locally in the background.\r\n");
+			fractal_render_async();
 		}
 		break;
 	case 'i':
 		if (module_data.state == module_idle) {
 			message msg = { .type = MSG_SET_COMPUTE };
+			if (fractal_get_auto_precision()) {
+				fractal_adapt_precision(UINT8_MAX); //The most Nucleo can compute
+			}
+			if (fractal_get_precision() > UINT8_MAX) {
+				fprintf(stderr, "ERROR: Nucleo cannot compute more than %d iterations, lower the precision first.\r\n",
+					UINT8_MAX);
+				break;
+			}
 			msg.data.set_compute = fractal_get_settings();
 			message_calculate_checksum(&msg);
 			message_enqueue(&msg);
@@ -635,10 +757,22 @@ void poll_stdin() {
 		else if (fractal_finished()) {
 			fprintf(stderr, "WARN: Nothing to do. You must first reset chunks.\r\n");
 		}
+		else if (fractal_is_deep()) {
+			fprintf(stderr, "ERROR: Nucleo computes in single precision, compute deep views locally.\r\n");
+		}
+		else if (fractal_get_precision() > UINT8_MAX) {
+			fprintf(stderr, "ERROR: Nucleo cannot compute more than %d iterations, compute locally.\r\n", UINT8_MAX);
+		}
 		else {
-			send_message_compute();
-			module_data.state = module_starting;
-			fprintf(stderr, "INFO: Started computation.\r\n");
+			//The Nucleo takes over the remaining chunks, the local render of the view (if any) is abandoned
+			fractal_cancel_render();
+			if (!send_message_compute()) {
+				fprintf(stderr, "INFO: All remaining chunks were found in the tile cache.\r\n");
+			}
+			else {
+				module_data.state = module_starting;
+				fprintf(stderr, "INFO: Started computation.\r\n");
+			}
 		}
 		break;
 
@@ -700,6 +834,9 @@ void poll_stdin() {
 		}
 		save_to_ppm();
 		break;
+	case 't':
+		fractal_print_stats();
+		break;
 
 	default:
 		fprintf(stderr, "WARN: Command '%c' is not recognized! Ignored.\r\n", command);
@@ -740,13 +877,12 @@ void handle_message(message msg) {
 	case MSG_DONE:
 		fprintf(stderr, "INFO: Nucleo finished entire chunk.\r\n");
 		fractal_finish_chunk();
-		if (fractal_finished()) {
+		if (!send_message_compute()) {
 			fprintf(stderr, "INFO: Work done, whole fractal calculated.\r\n");
 			module_data.state = module_idle;
 		}
 		else {
-			fprintf(stderr, "INFO: Starting next chunk.\r\n");
-			send_message_compute();
+			fprintf(stderr, "INFO: Started next chunk.\r\n");
 		}
 		break;
 
@@ -791,6 +927,9 @@ bool startup(int argc, char** argv) {
 
 	srand(time(0));
 
+	batch_select_kernel();
+	fprintf(stderr, "DEBUG: Using %s kernel for local computation.\n", batch_kernel_name(batch_get_kernel()));
+
 	assert(argc == 2);
 
 	fprintf(stderr, "DEBUG: Opening serial port...\n");
@@ -812,20 +951,169 @@ bool startup(int argc, char** argv) {
 
 	fractal_initialize(default_width, default_height, default_precision, default_chunk_cols,
 		default_chunk_rows, max_top_left, max_bot_right, default_fractal_constant);
+	//Views reachable by a single key of the free move mode are prefetched while idle
+	fractal_set_prefetch(true, move_coeeficient, zoom_coefficient);
+
+	//Persisting chunks is opt-in, nothing is written to disk unless the directory is given
+	char const* const tile_directory = getenv(tile_store_variable);
+	if (tile_directory && *tile_directory && !tile_store_open(tile_directory, default_tile_store_capacity)) {
+		fprintf(stderr, "WARN: Computed chunks will not be persisted.\r\n");
+	}
 
 	return true;
 }
 
+/* Headless mode (prgsem-main --animate ...). Renders a sweep of the constant and/or
+ the viewport to files without opening a window or the serial port. */
+int animate(int argc, char** argv) {
+	const char* const help = "Usage: %s --animate [-n frames] [-s WIDTHxHEIGHT] [-p precision] [-j threads]\n"
+		"    [-c re,im] [-C re,im] [-v left,top,right,bottom] [-V left,top,right,bottom] output\n\n"
+		"Renders an animation without opening a window. The constant moves from -c to -C and\n"
+		"the viewport from -v to -V, both stay put unless their end is given. Output ending\n"
+		"with .y4m (or -) is written as a YUV4MPEG2 stream, anything else is a printf pattern\n"
+		"of PPM file names, e.g. frame%%05d.ppm.\n";
+
+	struct animation a = { default_width, default_height, default_precision, 100,
+		default_fractal_constant, default_fractal_constant, max_top_left, max_bot_right, max_top_left, max_bot_right,
+		animation_y4m, NULL, sysconf(_SC_NPROCESSORS_ONLN) };
+	bool c_end = false, view_end = false, valid = true;
+
+	//argv[1] is "--animate", getopt takes it for the program name
+	for (int option; valid && (option = getopt(argc - 1, argv + 1, "n:s:p:j:c:C:v:V:")) != -1;) {
+		switch (option) {
+		case 'n': valid = sscanf(optarg, "%d", &a.frames) == 1; break;
+		case 's': valid = sscanf(optarg, "%dx%d", &a.width, &a.height) == 2; break;
+		case 'p': valid = sscanf(optarg, "%d", &a.precision) == 1; break;
+		case 'j': valid = sscanf(optarg, "%d", &a.threads) == 1; break;
+		case 'c': valid = sscanf(optarg, "%lf,%lf", &a.c_from.re, &a.c_from.im) == 2; break;
+		case 'C': valid = sscanf(optarg, "%lf,%lf", &a.c_to.re, &a.c_to.im) == 2; c_end = true; break;
+		case 'v':
+			valid = sscanf(optarg, "%lf,%lf,%lf,%lf", &a.top_left_from.re, &a.top_left_from.im,
+				&a.bottom_right_from.re, &a.bottom_right_from.im) == 4;
+			break;
+		case 'V':
+			valid = sscanf(optarg, "%lf,%lf,%lf,%lf", &a.top_left_to.re, &a.top_left_to.im,
+				&a.bottom_right_to.re, &a.bottom_right_to.im) == 4;
+			view_end = true;
+			break;
+		default: valid = false; break;
+		}
+	}
+	if (!valid || optind + 1 != argc - 1) {
+		fprintf(stderr, help, argv[0]);
+		return EXIT_FAILURE;
+	}
+	a.output = argv[optind + 1];
+	if (!c_end) {
+		a.c_to = a.c_from;
+	}
+	if (!view_end) {
+		a.top_left_to = a.top_left_from;
+		a.bottom_right_to = a.bottom_right_from;
+	}
+	size_t const length = strlen(a.output);
+	a.format = !strcmp(a.output, "-") || (length > 4 && !strcmp(a.output + length - 4, ".y4m"))
+		? animation_y4m : animation_ppm;
+
+	batch_select_kernel();
+	return animation_render(&a) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Headless mode (prgsem-main --stream ...). Renders a single image of any size
+ to a file by bands of rows, without opening a window or the serial port. */
+int stream(int argc, char** argv) {
+	const char* const help = "Usage: %s --stream [-s WIDTHxHEIGHT] [-p precision] [-j threads]\n"
+		"    [-c re,im] [-v left,top,right,bottom] output\n\n"
+		"Renders an image by bands of rows with bounded memory, so it may be larger than RAM\n"
+		"(e.g. 65536x65536). Output ending with .pfm gets raw iteration counts as floats,\n"
+		"anything else (including - for stdout) is a binary PPM.\n";
+
+	struct stream_image s = { default_width, default_height, default_precision, max_top_left, max_bot_right,
+		default_fractal_constant, stream_ppm, NULL, sysconf(_SC_NPROCESSORS_ONLN) };
+	bool valid = true;
+
+	//argv[1] is "--stream", getopt takes it for the program name
+	for (int option; valid && (option = getopt(argc - 1, argv + 1, "s:p:j:c:v:")) != -1;) {
+		switch (option) {
+		case 's': valid = sscanf(optarg, "%dx%d", &s.width, &s.height) == 2; break;
+		case 'p': valid = sscanf(optarg, "%d", &s.precision) == 1; break;
+		case 'j': valid = sscanf(optarg, "%d", &s.threads) == 1; break;
+		case 'c': valid = sscanf(optarg, "%lf,%lf", &s.c.re, &s.c.im) == 2; break;
+		case 'v':
+			valid = sscanf(optarg, "%lf,%lf,%lf,%lf", &s.top_left.re, &s.top_left.im,
+				&s.bottom_right.re, &s.bottom_right.im) == 4;
+			break;
+		default: valid = false; break;
+		}
+	}
+	if (!valid || optind + 1 != argc - 1) {
+		fprintf(stderr, help, argv[0]);
+		return EXIT_FAILURE;
+	}
+	s.output = argv[optind + 1];
+	size_t const length = strlen(s.output);
+	s.format = length > 4 && !strcmp(s.output + length - 4, ".pfm") ? stream_pfm : stream_ppm;
+
+	batch_select_kernel();
+	return stream_image_render(&s) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Headless mode (prgsem-main --tiled ...). Renders a huge image tile by tile
+ through a memory mapped file, resuming an interrupted job with the same parameters. */
+int tiled(int argc, char** argv) {
+	const char* const help = "Usage: %s --tiled [-s WIDTHxHEIGHT] [-t tile] [-p precision] [-j threads]\n"
+		"    [-c re,im] [-v left,top,right,bottom] output.ppm\n\n"
+		"Renders an image tile by tile into the memory mapped output.ppm.tiles, which is converted\n"
+		"to output.ppm once complete. Finished tiles are recorded in output.ppm.done, so that a job\n"
+		"interrupted by Ctrl-C or a crash continues where it stopped once run again with the same\n"
+		"parameters.\n";
+
+	struct tiled_image t = { default_width, default_height, default_precision, 256, max_top_left, max_bot_right,
+		default_fractal_constant, NULL, sysconf(_SC_NPROCESSORS_ONLN) };
+	bool valid = true;
+
+	//argv[1] is "--tiled", getopt takes it for the program name
+	for (int option; valid && (option = getopt(argc - 1, argv + 1, "s:t:p:j:c:v:")) != -1;) {
+		switch (option) {
+		case 's': valid = sscanf(optarg, "%dx%d", &t.width, &t.height) == 2; break;
+		case 't': valid = sscanf(optarg, "%d", &t.tile) == 1; break;
+		case 'p': valid = sscanf(optarg, "%d", &t.precision) == 1; break;
+		case 'j': valid = sscanf(optarg, "%d", &t.threads) == 1; break;
+		case 'c': valid = sscanf(optarg, "%lf,%lf", &t.c.re, &t.c.im) == 2; break;
+		case 'v':
+			valid = sscanf(optarg, "%lf,%lf,%lf,%lf", &t.top_left.re, &t.top_left.im,
+				&t.bottom_right.re, &t.bottom_right.im) == 4;
+			break;
+		default: valid = false; break;
+		}
+	}
+	if (!valid || optind + 1 != argc - 1) {
+		fprintf(stderr, help, argv[0]);
+		return EXIT_FAILURE;
+	}
+	t.output = argv[optind + 1];
+
+	batch_select_kernel();
+	return tiled_image_render(&t) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 /* Checks command line arguments, their count, order etc. Returns false on error.
   If an error is detected, prints simple help. Does not modify program state.*/
 bool check_args(int argc, char** argv) {
-	const char* const help = "Usage: %s serial_port\n\n"
+	const char* const help = "Usage: %s serial_port\n"
+		"       %s --animate [options] output\n"
+		"       %s --stream [options] output\n"
+		"       %s --tiled [options] output.ppm\n\n"
 		"This application is a driver for Julia set computation using device connected to\n"
 		"given serial port. Forwards commands from the user and draws intermediate results\n"
-		"to screen. Contains help (press h within the program).\r\n";
+		"to screen. Contains help (press h within the program).\n"
+		"With --animate renders an animation to files instead (see --animate -h),\n"
+		"with --stream a single image of any size (see --stream -h) and with --tiled\n"
+		"a huge image which may be interrupted and resumed (see --tiled -h).\n"
+		"Computed chunks are kept across runs in the directory named by %s, if set.\r\n";
 
 	if (argc != 2) {
-		fprintf(stderr, help, argv[0]);
+		fprintf(stderr, help, argv[0], argv[0], argv[0], argv[0], tile_store_variable);
 		return false;
 	}
 	//More checking done in function startup
@@ -835,6 +1123,15 @@ bool check_args(int argc, char** argv) {
 
 int main(int argc, char** argv) {
 
+	if (argc >= 2 && !strcmp(argv[1], "--animate")) {
+		return animate(argc, argv);
+	}
+	if (argc >= 2 && !strcmp(argv[1], "--stream")) {
+		return stream(argc, argv);
+	}
+	if (argc >= 2 && !strcmp(argv[1], "--tiled")) {
+		return tiled(argc, argv);
+	}
 	if (!check_args(argc, argv)) {
 		return EXIT_FAILURE;
 	}
@@ -933,6 +1230,7 @@ int main(int argc, char** argv) {
 		return EXIT_FAILURE;
 	}
 	fractal_cleanup();
+	tile_store_close();
 	fprintf(stderr, "INFO: Program successfully deinitialized.\n");
 	return EXIT_SUCCESS;
 }
@@ -18,7 +18,7 @@
 
 namespace {
 
-	constexpr uint8_t VERSION_MAJOR = 4, VERSION_MINOR = 2, VERSION_PATCH = 0;
+	constexpr uint8_t VERSION_MAJOR = 4, VERSION_MINOR = 3, VERSION_PATCH = 0;
 
 	constexpr char startup_string[] = "This4uHeli";
 
@@ -24,7 +24,7 @@ static int message_payload_size(message_type const type) {
 	case MSG_COMPUTE_DATA:
 		return 4;
 	case MSG_SET_COMPUTE:
-		return 1 + 4 * sizeof(float);
+		return 2 + 4 * sizeof(float);
 	case MSG_COMM:
 		return 4 + 1;
 	}
@@ -75,6 +75,7 @@ void message_decompose(const message* msg, uint8_t* buf, int size) {
 		memcpy(&(buf[1 + 2 * sizeof(float)]), &(msg->data.set_compute.d_re), sizeof(float));
 		memcpy(&(buf[1 + 3 * sizeof(float)]), &(msg->data.set_compute.d_im), sizeof(float));
 		buf[1 + 4 * sizeof(float)] = msg->data.set_compute.n;
+		buf[2 + 4 * sizeof(float)] = msg->data.set_compute.flags;
 		break;
 
 	case MSG_COMPUTE:
@@ -123,6 +124,7 @@ message message_parse(const uint8_t* buf, int size) {
 		memcpy(&(msg.data.set_compute.d_re), &(buf[1 + 2 * sizeof(float)]), sizeof(float));
 		memcpy(&(msg.data.set_compute.d_im), &(buf[1 + 3 * sizeof(float)]), sizeof(float));
 		msg.data.set_compute.n = buf[1 + 4 * sizeof(float)];
+		msg.data.set_compute.flags = buf[2 + 4 * sizeof(float)];
 		break;
 	case MSG_COMPUTE: // type + chunk_id + nbr_tasks
 		msg.data.compute.cid = buf[1];
@@ -55,8 +55,12 @@ extern "C" {
 		float d_re;  // increment in the x-coords
 		float d_im;  // increment in the y-coords
 		uint8_t n;    // number of iterations per each pixel
+		uint8_t flags; // combination of SET_COMPUTE_* bits below
 	} msg_set_compute;
 
+	//Detect periodic orbits and stop iterating them early (see convergence_test_periodic)
+#define SET_COMPUTE_PERIODICITY 0x01
+
 	typedef struct {
 		uint8_t cid; // chunk id
 		float re;    // start of the x-coords (real)
@@ -0,0 +1,162 @@
+
+#include "render_pool.h"
+
+#include <threads.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+/* Tasks are only ever removed from deques, so each of them is just a window
+ [head, tail) into the array of tasks of the current job. */
+struct deque {
+	mtx_t lock;
+	int head, tail;
+};
+
+static struct {
+	int size;
+	thrd_t* threads;
+	struct deque* deques;
+
+	mtx_t lock; //Protects all members below
+	cnd_t job_ready, job_done;
+	int generation; //Incremented with every job
+	int busy; //Number of workers still processing the current job
+	bool quit;
+
+	int const* tasks;
+	pool_work work;
+	void* arg;
+} pool;
+
+//Take task from the back of the deque (owner) or from its front (thief). Returns -1 if empty.
+static int deque_take(struct deque* d, bool steal) {
+	int task = -1;
+	mtx_lock(&d->lock);
+	if (d->head < d->tail) {
+		task = pool.tasks[steal ? d->head++ : --d->tail];
+	}
+	mtx_unlock(&d->lock);
+	return task;
+}
+
+static int next_task(int worker) {
+	int task = deque_take(&pool.deques[worker], false);
+	for (int i = 1; task == -1 && i < pool.size; ++i) {
+		task = deque_take(&pool.deques[(worker + i) % pool.size], true);
+	}
+	return task;
+}
+
+static int worker_thread(void* arg) {
+	int const worker = (int)(long)arg;
+	int seen = 0;
+
+	mtx_lock(&pool.lock);
+	for (;;) {
+		while (!pool.quit && seen == pool.generation) {
+			cnd_wait(&pool.job_ready, &pool.lock);
+		}
+		if (pool.quit) {
+			break;
+		}
+		seen = pool.generation;
+		mtx_unlock(&pool.lock);
+
+		for (int task; (task = next_task(worker)) != -1;) {
+			pool.work(task, worker, pool.arg);
+		}
+
+		mtx_lock(&pool.lock);
+		if (--pool.busy == 0) {
+			cnd_signal(&pool.job_done);
+		}
+	}
+	mtx_unlock(&pool.lock);
+	return 0;
+}
+
+bool pool_start(int threads) {
+	assert(threads > 0 && pool.size == 0);
+
+	pool.threads = malloc(threads * sizeof(thrd_t));
+	pool.deques = malloc(threads * sizeof(struct deque));
+	if (!pool.threads || !pool.deques) {
+		fprintf(stderr, "ERROR: Cannot allocate data for %d rendering threads.\r\n", threads);
+		free(pool.threads);
+		free(pool.deques);
+		return false;
+	}
+	mtx_init(&pool.lock, mtx_plain);
+	cnd_init(&pool.job_ready);
+	cnd_init(&pool.job_done);
+	pool.quit = false;
+	pool.generation = 0;
+
+	for (int i = 0; i < threads; ++i) {
+		mtx_init(&pool.deques[i].lock, mtx_plain);
+		pool.deques[i].head = pool.deques[i].tail = 0;
+		if (thrd_create(&pool.threads[i], &worker_thread, (void*)(long)i) != thrd_success) {
+			fprintf(stderr, "ERROR: Cannot start rendering thread %d.\r\n", i);
+			mtx_destroy(&pool.deques[i].lock); //pool_stop destroys those of started threads only
+			pool.size = i;
+			pool_stop();
+			return false;
+		}
+		pool.size = i + 1;
+	}
+	return true;
+}
+
+void pool_stop() {
+	if (!pool.threads) {
+		return;
+	}
+	mtx_lock(&pool.lock);
+	pool.quit = true;
+	cnd_broadcast(&pool.job_ready);
+	mtx_unlock(&pool.lock);
+
+	for (int i = 0; i < pool.size; ++i) {
+		thrd_join(pool.threads[i], NULL);
+		mtx_destroy(&pool.deques[i].lock);
+	}
+	mtx_destroy(&pool.lock);
+	cnd_destroy(&pool.job_ready);
+	cnd_destroy(&pool.job_done);
+	free(pool.threads);
+	free(pool.deques);
+	pool.threads = NULL;
+	pool.deques = NULL;
+	pool.size = 0;
+}
+
+int pool_size() {
+	return pool.size;
+}
+
+void pool_run(int const* tasks, int count, pool_work work, void* arg) {
+	assert(pool.size > 0);
+	if (count == 0) {
+		return;
+	}
+
+	mtx_lock(&pool.lock);
+	pool.tasks = tasks;
+	pool.work = work;
+	pool.arg = arg;
+	//Neighbouring tasks tend to touch neighbouring memory, keep them on one thread
+	for (int i = 0; i < pool.size; ++i) {
+		pool.deques[i].head = (long)count * i / pool.size;
+		pool.deques[i].tail = (long)count * (i + 1) / pool.size;
+	}
+	pool.busy = pool.size;
+	++pool.generation;
+	cnd_broadcast(&pool.job_ready);
+
+	while (pool.busy > 0) {
+		cnd_wait(&pool.job_done, &pool.lock);
+	}
+	pool.tasks = NULL;
+	mtx_unlock(&pool.lock);
+}
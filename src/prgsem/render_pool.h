@@ -0,0 +1,25 @@
+#ifndef RENDER_POOL_H
+#define RENDER_POOL_H
+
+#include <stdbool.h>
+
+/* Function processing a single task. 'worker' is index of the thread running it
+ (0 <= worker < pool_size()), 'arg' is passed unchanged from pool_run. */
+typedef void (*pool_work)(int task, int worker, void* arg);
+
+/* Spawn 'threads' worker threads. Returns false if they cannot be created. */
+bool pool_start(int threads);
+
+/* Finish workers and free all resources. No-op if the pool is not running. */
+void pool_stop();
+
+//Returns number of worker threads (0 if the pool is not running)
+int pool_size();
+
+/* Process 'count' tasks using all workers, return once all of them are done.
+ Each worker owns a deque initially holding a contiguous share of the tasks. It takes
+ tasks from the back of its own deque and, once that is empty, steals from the front
+ of deques of other workers. */
+void pool_run(int const* tasks, int count, pool_work work, void* arg);
+
+#endif
@@ -0,0 +1,149 @@
+
+#include "stream_image.h"
+#include "juliaset_batch.h"
+#include "palette.h"
+#include "render_pool.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+//Memory spent on a single band of rows
+static size_t const band_budget = 16 << 20;
+
+//Everything a row task needs to know about the band being computed
+struct band {
+	struct stream_image const* s;
+	int first_row;
+	double dx, dy;
+	bool use_float;
+	uint16_t* counts; //Row by row, starting by 'first_row'
+};
+
+static void compute_row(int task, int worker, void* arg) {
+	struct band const* const b = arg;
+	int const width = b->s->width;
+	int iterations[width];
+	my_complex const start = { b->s->top_left.re, b->s->top_left.im - (long)(b->first_row + task) * b->dy };
+	(b->use_float ? &convergence_test_row_float : &convergence_test_row)(start, b->dx, 0, 1, width, b->s->c,
+		b->s->precision, 0.0, iterations, NULL);
+	uint16_t* const counts = b->counts + (size_t)task * width;
+	for (int i = 0; i < width; ++i) {
+		counts[i] = iterations[i];
+	}
+}
+
+//Converts 'rows' rows of the band to the output format and writes them
+static bool write_band(struct band const* b, int rows, FILE* output, void* converted) {
+	int const width = b->s->width;
+	if (b->s->format == stream_ppm) {
+		palette_color_counts(b->counts, rows * width, converted);
+		return fwrite(converted, 3 * (size_t)width, rows, output) == (size_t)rows;
+	}
+	//PFM stores rows from the bottom up
+	float* const values = converted;
+	for (int row = rows - 1; row >= 0; --row) {
+		uint16_t const* const counts = b->counts + (size_t)row * width;
+		for (int i = 0; i < width; ++i) {
+			values[i] = counts[i];
+		}
+		if (fwrite(values, sizeof(float), width, output) != (size_t)width) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+bool stream_image_render(struct stream_image const* s) {
+	if (s->width <= 0 || s->height <= 0 || s->precision < 1 || s->precision > UINT16_MAX) {
+		fprintf(stderr, "ERROR: Invalid image parameters.\r\n");
+		return false;
+	}
+	if (s->format == stream_ppm && !palette_rebuild(s->precision)) {
+		return false;
+	}
+
+	size_t const bytes_per_pixel = sizeof(uint16_t) + (s->format == stream_ppm ? 3 : sizeof(float));
+	size_t const band_rows = band_budget / (bytes_per_pixel * s->width);
+	int const rows = band_rows < 1 ? 1 : band_rows > (size_t)s->height ? s->height : (int)band_rows;
+
+	struct band b = { s, 0, (s->bottom_right.re - s->top_left.re) / s->width,
+		(s->top_left.im - s->bottom_right.im) / s->height, false, NULL };
+	b.use_float = batch_float_sufficient(b.dx) && batch_float_sufficient(b.dy);
+	b.counts = malloc(sizeof(uint16_t) * rows * s->width);
+	void* const converted = malloc((s->format == stream_ppm ? 3 * (size_t)rows : sizeof(float)) * s->width);
+	int* const tasks = malloc(sizeof(int) * rows);
+	FILE* const output = strcmp(s->output, "-") ? fopen(s->output, "wb") : stdout;
+	bool ok = b.counts && converted && tasks && output;
+	if (!ok) {
+		fprintf(stderr, "ERROR: Cannot allocate bands or open %s.\r\n", s->output);
+	}
+	else if (s->format == stream_ppm) {
+		ok = fprintf(output, "P6\n%d\n%d\n255\n", s->width, s->height) > 0;
+	}
+	else {
+		ok = fprintf(output, "Pf\n%d %d\n-1.0\n", s->width, s->height) > 0; //Negative scale means little endian
+	}
+	bool const own_pool = ok && s->threads > 1 && pool_size() == 0 && pool_start(s->threads);
+	for (int i = 0; ok && i < rows; ++i) {
+		tasks[i] = i;
+	}
+
+	if (ok) {
+		fprintf(stderr, "INFO: Streaming %dx%d image by bands of %d rows using %d threads and %s kernel.\r\n",
+			s->width, s->height, rows, pool_size() > 1 ? pool_size() : 1, batch_kernel_name(batch_get_kernel()));
+	}
+	double const start = now();
+	int const bands = (s->height + rows - 1) / rows;
+	for (int band = 0; ok && band < bands; ++band) {
+		//PFM is written from the bottom, so bands go in reverse order too
+		int const index = s->format == stream_pfm ? bands - 1 - band : band;
+		b.first_row = index * rows;
+		int const count = b.first_row + rows > s->height ? s->height - b.first_row : rows;
+		if (pool_size() > 1) {
+			pool_run(tasks, count, &compute_row, &b);
+		}
+		else {
+			for (int i = 0; i < count; ++i) {
+				compute_row(i, 0, &b);
+			}
+		}
+		ok = write_band(&b, count, output, converted);
+		if (!ok) {
+			fprintf(stderr, "ERROR: Cannot write to %s.\r\n", s->output);
+		}
+	}
+	if (output && output != stdout && fclose(output)) {
+		ok = false;
+	}
+	else if (output == stdout) {
+		fflush(stdout);
+	}
+
+	if (ok) {
+		double const elapsed = now() - start;
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		fprintf(stderr, "INFO: Rendered %.1f Mpixels in %.3f s (%.1f Mpixels/s).\r\n",
+			(double)s->width * s->height * 1e-6, elapsed, (double)s->width * s->height * 1e-6 / elapsed);
+		fprintf(stderr, "INFO: Peak resident set size %ld KiB.\r\n", usage.ru_maxrss);
+	}
+
+	if (own_pool) {
+		pool_stop();
+	}
+	free(b.counts);
+	free(converted);
+	free(tasks);
+	palette_cleanup();
+	return ok;
+}
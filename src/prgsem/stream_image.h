@@ -0,0 +1,27 @@
+#ifndef STREAM_IMAGE_H
+#define STREAM_IMAGE_H
+
+#include <stdbool.h>
+#include "juliaset.h"
+
+//File format of streamed images
+enum stream_format {
+	stream_ppm, //Binary PPM colored by the palette
+	stream_pfm //Grayscale PFM holding raw iteration counts as floats
+};
+
+/* Headless render of a single image, which need not fit into memory. */
+struct stream_image {
+	int width, height, precision;
+	my_complex top_left, bottom_right, c;
+	enum stream_format format;
+	char const* output; //Path of the file, "-" for stdout
+	int threads; //Threads computing each band
+};
+
+/* Render the image by bands of rows, each band is computed in parallel and written right
+ away, so memory used stays bounded (a few MiB) regardless of the image size. Prints
+ throughput and peak resident set size to stderr. Returns false if the output cannot be written. */
+bool stream_image_render(struct stream_image const* s);
+
+#endif
@@ -0,0 +1,297 @@
+
+#include "tile_cache.h"
+#include "tile_store.h"
+
+#include <threads.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+struct tile {
+	struct tile_key key;
+	uint64_t hash;
+	struct tile* prev, * next; //LRU list, the most recently used tile first
+	struct tile* chain; //Next tile in the same bucket
+	size_t size; //Bytes occupied by the tile including this header
+	bool speculative; //Prefetched and not looked up yet
+	uint16_t counts[];
+};
+
+enum { bucket_count = 4096 };
+
+static struct {
+	mtx_t lock; //Protects all members below, tiles are used by the rendering pool
+	struct tile** buckets;
+	struct tile* head, * tail;
+	size_t size, capacity;
+	size_t speculative_size; //Bytes of speculative tiles
+	int tiles;
+	long hits, misses, evictions;
+	long prefetched, prefetch_hits, prefetch_wasted;
+} cache;
+
+//Fraction of the capacity speculative tiles may occupy, so that they never push out many real ones
+static double const speculative_share = 0.25;
+
+struct tile_key tile_key_make(double re, double im, double d_re, double d_im, double c_re, double c_im,
+	double tolerance, int flags, int precision, int n_re, int n_im) {
+	struct tile_key key;
+	memset(&key, 0, sizeof key); //Keys are hashed and compared bytewise, including padding
+	key.re = re;
+	key.im = im;
+	key.d_re = d_re;
+	key.d_im = d_im;
+	key.c_re = c_re;
+	key.c_im = c_im;
+	key.tolerance = tolerance;
+	key.flags = flags;
+	key.precision = precision;
+	key.n_re = n_re;
+	key.n_im = n_im;
+	key.version = TILE_KERNEL_VERSION;
+	return key;
+}
+
+//FNV-1a of all bytes of the key
+uint64_t tile_key_hash(struct tile_key const* key) {
+	uint8_t const* const bytes = (uint8_t const*)key;
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < sizeof * key; ++i) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+bool tile_cache_init(size_t capacity) {
+	assert(!cache.buckets);
+	cache.buckets = calloc(bucket_count, sizeof(struct tile*));
+	if (!cache.buckets) {
+		fprintf(stderr, "ERROR: Cannot allocate tile cache.\r\n");
+		return false;
+	}
+	mtx_init(&cache.lock, mtx_plain);
+	cache.capacity = capacity;
+	return true;
+}
+
+static void unlink_lru(struct tile* t) {
+	if (t->prev) {
+		t->prev->next = t->next;
+	}
+	else {
+		cache.head = t->next;
+	}
+	if (t->next) {
+		t->next->prev = t->prev;
+	}
+	else {
+		cache.tail = t->prev;
+	}
+}
+
+static void push_front(struct tile* t) {
+	t->prev = NULL;
+	t->next = cache.head;
+	if (cache.head) {
+		cache.head->prev = t;
+	}
+	cache.head = t;
+	if (!cache.tail) {
+		cache.tail = t;
+	}
+}
+
+//Removes the tile from both the bucket and the LRU list and frees it
+static void remove_tile(struct tile* t) {
+	struct tile** link = &cache.buckets[t->hash % bucket_count];
+	while (*link != t) {
+		link = &(*link)->chain;
+	}
+	*link = t->chain;
+	unlink_lru(t);
+	cache.size -= t->size;
+	--cache.tiles;
+	if (t->speculative) {
+		cache.speculative_size -= t->size;
+		++cache.prefetch_wasted;
+	}
+	free(t);
+}
+
+//Tile is used for real, it no longer counts as speculative
+static void promote(struct tile* t) {
+	t->speculative = false;
+	cache.speculative_size -= t->size;
+}
+
+static struct tile* find(struct tile_key const* key, uint64_t hash) {
+	for (struct tile* t = cache.buckets[hash % bucket_count]; t; t = t->chain) {
+		if (t->hash == hash && !memcmp(&t->key, key, sizeof * key)) {
+			return t;
+		}
+	}
+	return NULL;
+}
+
+void tile_cache_clear() {
+	if (!cache.buckets) {
+		return;
+	}
+	mtx_lock(&cache.lock);
+	while (cache.head) {
+		remove_tile(cache.head);
+	}
+	cache.hits = cache.misses = cache.evictions = 0;
+	cache.prefetched = cache.prefetch_hits = cache.prefetch_wasted = 0;
+	mtx_unlock(&cache.lock);
+}
+
+void tile_cache_cleanup() {
+	if (!cache.buckets) {
+		return;
+	}
+	tile_cache_clear();
+	mtx_destroy(&cache.lock);
+	free(cache.buckets);
+	cache.buckets = NULL;
+}
+
+//Inserts (or replaces) the tile, has to be called with the lock held
+static void insert(struct tile_key const* key, uint64_t hash, uint16_t const* counts) {
+	size_t const size = sizeof(struct tile) + sizeof(uint16_t) * key->n_re * key->n_im;
+	if (size > cache.capacity) {
+		return;
+	}
+	struct tile* t = find(key, hash);
+	if (t) {
+		unlink_lru(t);
+		if (t->speculative) {
+			//Computed again before anybody looked it up
+			promote(t);
+			++cache.prefetch_wasted;
+		}
+	}
+	else {
+		while (cache.size + size > cache.capacity) {
+			remove_tile(cache.tail);
+			++cache.evictions;
+		}
+		t = malloc(size);
+		if (!t) {
+			return;
+		}
+		t->key = *key;
+		t->hash = hash;
+		t->size = size;
+		t->speculative = false;
+		t->chain = cache.buckets[hash % bucket_count];
+		cache.buckets[hash % bucket_count] = t;
+		cache.size += size;
+		++cache.tiles;
+	}
+	memcpy(t->counts, counts, sizeof(uint16_t) * key->n_re * key->n_im);
+	push_front(t);
+}
+
+bool tile_cache_lookup(struct tile_key const* key, uint16_t* counts) {
+	if (!cache.buckets) {
+		return false;
+	}
+	uint64_t const hash = tile_key_hash(key);
+	mtx_lock(&cache.lock);
+	struct tile* const t = find(key, hash);
+	bool const hit = t != NULL;
+	bool const prefetched = hit && t->speculative;
+	if (hit) {
+		memcpy(counts, t->counts, sizeof(uint16_t) * key->n_re * key->n_im);
+		unlink_lru(t);
+		push_front(t);
+		++cache.hits;
+		if (prefetched) {
+			promote(t);
+			++cache.prefetch_hits;
+		}
+	}
+	else {
+		++cache.misses;
+	}
+	mtx_unlock(&cache.lock);
+
+	if (prefetched) {
+		tile_store_save(key, counts); //Speculative tiles are persisted only once used
+	}
+
+	//Disk is accessed without holding the lock, so that other threads may use the memory meanwhile
+	if (!hit && tile_store_load(key, counts)) {
+		mtx_lock(&cache.lock);
+		insert(key, hash, counts);
+		mtx_unlock(&cache.lock);
+		return true;
+	}
+	return hit;
+}
+
+void tile_cache_store(struct tile_key const* key, uint16_t const* counts) {
+	if (!cache.buckets) {
+		return;
+	}
+	mtx_lock(&cache.lock);
+	insert(key, tile_key_hash(key), counts);
+	mtx_unlock(&cache.lock);
+	tile_store_save(key, counts);
+}
+
+bool tile_cache_contains(struct tile_key const* key) {
+	if (!cache.buckets) {
+		return false;
+	}
+	mtx_lock(&cache.lock);
+	bool const found = find(key, tile_key_hash(key)) != NULL;
+	mtx_unlock(&cache.lock);
+	return found;
+}
+
+void tile_cache_prefetch(struct tile_key const* key, uint16_t const* counts) {
+	if (!cache.buckets) {
+		return;
+	}
+	size_t const size = sizeof(struct tile) + sizeof(uint16_t) * key->n_re * key->n_im;
+	size_t const budget = cache.capacity * speculative_share;
+	uint64_t const hash = tile_key_hash(key);
+	mtx_lock(&cache.lock);
+	if (size <= budget && !find(key, hash)) {
+		//Make room among speculative tiles first, starting by the least recently prefetched one
+		for (struct tile* t = cache.tail; t && cache.speculative_size + size > budget;) {
+			struct tile* const prev = t->prev;
+			if (t->speculative) {
+				remove_tile(t);
+			}
+			t = prev;
+		}
+		insert(key, hash, counts);
+		struct tile* const t = find(key, hash);
+		if (t) {
+			t->speculative = true;
+			cache.speculative_size += t->size;
+			++cache.prefetched;
+		}
+	}
+	mtx_unlock(&cache.lock);
+}
+
+void tile_cache_print_stats() {
+	if (!cache.buckets) {
+		return;
+	}
+	mtx_lock(&cache.lock);
+	long const lookups = cache.hits + cache.misses;
+	fprintf(stderr, "    Tile cache: %d tiles in %zu of %zu KiB, %ld evicted.\r\n"
+		, cache.tiles, cache.size / 1024, cache.capacity / 1024, cache.evictions);
+	fprintf(stderr, "    Tile cache: %ld hits, %ld misses (%.1f %% hit ratio).\r\n"
+		, cache.hits, cache.misses, lookups ? 100.0 * cache.hits / lookups : 0.0);
+	fprintf(stderr, "    Tile cache: %ld tiles prefetched, %ld of them used, %ld wasted.\r\n"
+		, cache.prefetched, cache.prefetch_hits, cache.prefetch_wasted);
+	mtx_unlock(&cache.lock);
+	tile_store_print_stats();
+}
@@ -0,0 +1,65 @@
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Version of the iteration kernels stored in tile keys. Bump it whenever the kernels start
+ producing different counts, so that tiles persisted by older builds are not reused. */
+#define TILE_KERNEL_VERSION 3
+
+//Flags of tile keys
+#define TILE_FLOAT_KERNEL 1 //Counts come from a single precision kernel
+
+/* Identifies a rendered tile (chunk) together with everything the counts depend on. Build it
+ by tile_key_make. Doubles are compared by their exact bit patterns, so a tile is only reused
+ for exactly the points, constant and kernel it was computed by. */
+struct tile_key {
+	double re, im; //top left corner
+	double d_re, d_im; //pixel spacing
+	double c_re, c_im; //constant C
+	double tolerance; //of periodicity checking, zero if disabled
+	int precision;
+	int n_re, n_im; //size in pixels
+	int flags; //TILE_FLOAT_KERNEL
+	int version; //TILE_KERNEL_VERSION
+};
+
+struct tile_key tile_key_make(double re, double im, double d_re, double d_im, double c_re, double c_im,
+	double tolerance, int flags, int precision, int n_re, int n_im);
+
+//Hash of all bytes of the key, names tiles in the tile store
+uint64_t tile_key_hash(struct tile_key const* key);
+
+/* Allocate the table, tiles are evicted once their total size exceeds 'capacity' bytes. */
+bool tile_cache_init(size_t capacity);
+
+/* Free all tiles. */
+void tile_cache_cleanup();
+
+/* Copy iteration counts of the tile (n_re * n_im, row by row) to 'counts'. Tiles missing
+ in memory are looked up in the tile store (if open). Returns false on a miss.
+ The tile becomes the most recently used one. */
+bool tile_cache_lookup(struct tile_key const* key, uint16_t* counts);
+
+/* Insert (or replace) the tile, evicting the least recently used ones if necessary.
+ The tile is saved to the tile store as well. */
+void tile_cache_store(struct tile_key const* key, uint16_t const* counts);
+
+//Returns true iff the tile is in memory, neither counters nor the LRU order are affected
+bool tile_cache_contains(struct tile_key const* key);
+
+/* Insert a speculatively computed tile unless the cache holds it already. Speculative tiles
+ take at most a quarter of the capacity, the least recently used of them make room for new
+ ones. A speculative tile is promoted (and saved to the tile store) when it is looked up,
+ it counts as wasted if it is evicted or computed again first. */
+void tile_cache_prefetch(struct tile_key const* key, uint16_t const* counts);
+
+//Drop all tiles and reset counters
+void tile_cache_clear();
+
+//Prints number of tiles, memory used, hit/miss and prefetch counters to stderr
+void tile_cache_print_stats();
+
+#endif
@@ -0,0 +1,321 @@
+
+#include "tile_store.h"
+
+#include <threads.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//Magic number and version of the file format, not of the kernels (that one is part of the key)
+static char const tile_magic[4] = { 'J', 'T', 'I', 'L' };
+enum { tile_format = 1 };
+//Temporary files older than this (in seconds) are left behind by a crash even if their owner seems alive
+enum { temporary_lifetime = 3600 };
+
+//Every file starts with this header followed by n_re * n_im iteration counts
+struct tile_header {
+	char magic[4];
+	uint32_t format;
+	struct tile_key key;
+};
+
+static struct {
+	char directory[PATH_MAX / 2];
+	bool open;
+	mtx_t lock; //Protects members below, tiles are saved by the rendering pool
+	size_t size, capacity;
+	int tiles;
+	long hits, misses, writes, evictions;
+	unsigned temporaries; //Makes names of temporary files unique
+} store;
+
+static size_t tile_file_size(struct tile_key const* key) {
+	return sizeof(struct tile_header) + sizeof(uint16_t) * key->n_re * key->n_im;
+}
+
+static void tile_path(char* path, struct tile_key const* key) {
+	snprintf(path, PATH_MAX, "%s/%016" PRIx64 ".tile", store.directory, tile_key_hash(key));
+}
+
+static bool is_tile_name(char const* name) {
+	size_t const length = strlen(name);
+	return length > 5 && !strcmp(name + length - 5, ".tile");
+}
+
+static bool is_temporary_name(char const* name) {
+	size_t const length = strlen(name);
+	return length > 4 && !strcmp(name + length - 4, ".tmp");
+}
+
+/* Temporary files are named <hash>.<pid>.<id>.tmp by the process writing them. Returns true
+ if the one called 'name' was left behind, i.e. its owner no longer runs or it is too old.
+ The directory may be shared by other processes, whose temporaries are about to be renamed. */
+static bool is_stale_temporary(int directory, char const* name) {
+	long owner;
+	if (sscanf(name, "%*x.%ld.", &owner) == 1 && owner > 0
+		&& kill((pid_t)owner, 0) == -1 && errno == ESRCH) {
+		return true;
+	}
+	struct stat info;
+	return !fstatat(directory, name, &info, 0) && time(NULL) - info.st_mtime > temporary_lifetime;
+}
+
+struct stored_tile {
+	time_t used;
+	size_t size;
+	char name[NAME_MAX + 1];
+};
+
+static int by_usage(void const* a, void const* b) {
+	time_t const x = ((struct stored_tile const*)a)->used, y = ((struct stored_tile const*)b)->used;
+	return (x > y) - (x < y);
+}
+
+/* Deletes least recently used tiles (by modification time, which is updated on each load)
+ until the store is under 3/4 of its capacity. Has to be called with the lock held. */
+static void evict() {
+	DIR* const dir = opendir(store.directory);
+	if (!dir) {
+		return;
+	}
+	int count = 0, allocated = 256;
+	struct stored_tile* tiles = malloc(sizeof(struct stored_tile) * allocated);
+	size_t size = 0;
+	for (struct dirent* entry; tiles && (entry = readdir(dir));) {
+		struct stat info;
+		if (!is_tile_name(entry->d_name) || fstatat(dirfd(dir), entry->d_name, &info, 0)) {
+			continue;
+		}
+		if (count == allocated) {
+			allocated *= 2;
+			struct stored_tile* const larger = realloc(tiles, sizeof(struct stored_tile) * allocated);
+			if (!larger) {
+				break;
+			}
+			tiles = larger;
+		}
+		tiles[count].used = info.st_mtime;
+		tiles[count].size = info.st_size;
+		strcpy(tiles[count].name, entry->d_name);
+		size += info.st_size;
+		++count;
+	}
+	if (tiles) {
+		//Other processes may share the directory, so trust what is on disk
+		store.size = size;
+		store.tiles = count;
+		qsort(tiles, count, sizeof(struct stored_tile), &by_usage);
+		for (int i = 0; i < count && store.size > store.capacity / 4 * 3; ++i) {
+			if (!unlinkat(dirfd(dir), tiles[i].name, 0)) {
+				store.size -= tiles[i].size;
+				--store.tiles;
+				++store.evictions;
+			}
+		}
+	}
+	free(tiles);
+	closedir(dir);
+}
+
+bool tile_store_open(char const* directory, size_t capacity) {
+	tile_store_close();
+	if (strlen(directory) >= sizeof store.directory) {
+		fprintf(stderr, "ERROR: Tile store path %s is too long.\r\n", directory);
+		return false;
+	}
+	if (mkdir(directory, 0755) && errno != EEXIST) {
+		fprintf(stderr, "ERROR: Cannot create tile store %s: %s.\r\n", directory, strerror(errno));
+		return false;
+	}
+	DIR* const dir = opendir(directory);
+	if (!dir) {
+		fprintf(stderr, "ERROR: Cannot open tile store %s: %s.\r\n", directory, strerror(errno));
+		return false;
+	}
+	strcpy(store.directory, directory);
+	store.size = 0;
+	store.tiles = 0;
+	for (struct dirent* entry; (entry = readdir(dir));) {
+		struct stat info;
+		if (is_temporary_name(entry->d_name)) {
+			if (is_stale_temporary(dirfd(dir), entry->d_name)) {
+				unlinkat(dirfd(dir), entry->d_name, 0); //Left behind by a crash
+			}
+		}
+		else if (is_tile_name(entry->d_name) && !fstatat(dirfd(dir), entry->d_name, &info, 0)) {
+			store.size += info.st_size;
+			++store.tiles;
+		}
+	}
+	closedir(dir);
+	mtx_init(&store.lock, mtx_plain);
+	store.capacity = capacity;
+	store.hits = store.misses = store.writes = store.evictions = 0;
+	store.open = true;
+	if (store.size > store.capacity) {
+		evict();
+	}
+	fprintf(stderr, "INFO: Tile store %s holds %d tiles (%zu KiB).\r\n", directory, store.tiles, store.size / 1024);
+	return true;
+}
+
+void tile_store_close() {
+	if (!store.open) {
+		return;
+	}
+	store.open = false;
+	mtx_destroy(&store.lock);
+}
+
+//Returns true iff size and header of the file match the tile, counts are not read
+static bool holds_tile(int fd, struct tile_key const* key) {
+	struct stat info;
+	struct tile_header header;
+	return !fstat(fd, &info) && (size_t)info.st_size == tile_file_size(key)
+		&& pread(fd, &header, sizeof header, 0) == sizeof header
+		&& !memcmp(header.magic, tile_magic, sizeof tile_magic)
+		&& header.format == tile_format && !memcmp(&header.key, key, sizeof * key);
+}
+
+//Maps the file and checks that it really contains the requested tile
+static bool read_tile(int fd, struct tile_key const* key, uint16_t* counts) {
+	struct stat info;
+	size_t const size = tile_file_size(key);
+	if (fstat(fd, &info) || (size_t)info.st_size != size) {
+		return false;
+	}
+	void* const data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+	struct tile_header const* const header = data;
+	bool const valid = !memcmp(header->magic, tile_magic, sizeof tile_magic)
+		&& header->format == tile_format && !memcmp(&header->key, key, sizeof * key);
+	if (valid) {
+		memcpy(counts, header + 1, size - sizeof * header);
+	}
+	munmap(data, size);
+	return valid;
+}
+
+bool tile_store_load(struct tile_key const* key, uint16_t* counts) {
+	if (!store.open) {
+		return false;
+	}
+	char path[PATH_MAX];
+	tile_path(path, key);
+	int const fd = open(path, O_RDONLY);
+	bool const hit = fd != -1 && read_tile(fd, key, counts);
+	if (hit) {
+		futimens(fd, NULL); //Modification time serves as the time of last use for eviction
+	}
+	if (fd != -1) {
+		close(fd);
+	}
+	mtx_lock(&store.lock);
+	++*(hit ? &store.hits : &store.misses);
+	mtx_unlock(&store.lock);
+	return hit;
+}
+
+static bool write_all(int fd, void const* data, size_t size) {
+	for (uint8_t const* bytes = data; size;) {
+		ssize_t const written = write(fd, bytes, size);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		bytes += written;
+		size -= written;
+	}
+	return true;
+}
+
+void tile_store_save(struct tile_key const* key, uint16_t const* counts) {
+	if (!store.open) {
+		return;
+	}
+	char path[PATH_MAX], temporary[PATH_MAX];
+	tile_path(path, key);
+	/* Keys hold everything the counts depend on (see tile_key_make), so a file holding the same key
+	 just counts as used. Files of other keys sharing the hash are replaced. */
+	int const existing = open(path, O_RDONLY);
+	if (existing != -1) {
+		bool const same = holds_tile(existing, key);
+		if (same) {
+			futimens(existing, NULL);
+		}
+		close(existing);
+		if (same) {
+			return;
+		}
+	}
+
+	mtx_lock(&store.lock);
+	unsigned const id = store.temporaries++;
+	mtx_unlock(&store.lock);
+	snprintf(temporary, sizeof temporary, "%s/%016" PRIx64 ".%ld.%u.tmp", store.directory, tile_key_hash(key),
+		(long)getpid(), id);
+
+	struct tile_header header;
+	memset(&header, 0, sizeof header);
+	memcpy(header.magic, tile_magic, sizeof tile_magic);
+	header.format = tile_format;
+	header.key = *key;
+
+	int const fd = open(temporary, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (fd == -1) {
+		fprintf(stderr, "WARN: Cannot save tile %s: %s.\r\n", temporary, strerror(errno));
+		return;
+	}
+	//Flushed before the rename, so that a crash cannot leave a tile name with partial contents
+	bool const written = write_all(fd, &header, sizeof header)
+		&& write_all(fd, counts, sizeof(uint16_t) * key->n_re * key->n_im) && !fsync(fd);
+	close(fd);
+
+	struct stat former; //Another thread or process may have saved the tile meanwhile
+	bool const replaced = !stat(path, &former);
+	if (!written || rename(temporary, path)) {
+		fprintf(stderr, "WARN: Cannot save tile %s: %s.\r\n", path, strerror(errno));
+		unlink(temporary);
+		return;
+	}
+
+	mtx_lock(&store.lock);
+	if (replaced) {
+		store.size -= former.st_size;
+		--store.tiles;
+	}
+	store.size += tile_file_size(key);
+	++store.tiles;
+	++store.writes;
+	if (store.size > store.capacity) {
+		evict();
+	}
+	mtx_unlock(&store.lock);
+}
+
+void tile_store_print_stats() {
+	if (!store.open) {
+		return;
+	}
+	mtx_lock(&store.lock);
+	long const lookups = store.hits + store.misses;
+	fprintf(stderr, "    Tile store: %d tiles in %zu of %zu KiB, %ld written, %ld evicted.\r\n"
+		, store.tiles, store.size / 1024, store.capacity / 1024, store.writes, store.evictions);
+	fprintf(stderr, "    Tile store: %ld hits, %ld misses (%.1f %% hit ratio).\r\n"
+		, store.hits, store.misses, lookups ? 100.0 * store.hits / lookups : 0.0);
+	mtx_unlock(&store.lock);
+}
@@ -0,0 +1,32 @@
+#ifndef TILE_STORE_H
+#define TILE_STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tile_cache.h"
+
+/* Persistent counterpart of the tile cache. Every tile is a single file in one directory,
+ named by the hash of its key (see tile_key_hash). Files are written to a temporary name
+ and renamed into place, so that a crash never leaves a torn tile behind. Tiles are read
+ through mmap only when they are looked up. The store is disabled until opened. */
+
+/* Open (and create if necessary) the directory. Least recently used tiles are deleted once
+ the total size of all tiles exceeds 'capacity' bytes. Returns false if the directory is unusable. */
+bool tile_store_open(char const* directory, size_t capacity);
+
+//Stop using the directory, tiles stay on disk
+void tile_store_close();
+
+/* Copy iteration counts of the tile to 'counts' (n_re * n_im, row by row).
+ Returns false if the tile is not stored or its file is damaged. */
+bool tile_store_load(struct tile_key const* key, uint16_t* counts);
+
+/* Write the tile to disk unless it is stored already. Errors are reported, but not fatal. */
+void tile_store_save(struct tile_key const* key, uint16_t const* counts);
+
+//Prints number of tiles, disk space used and hit/miss counters to stderr
+void tile_store_print_stats();
+
+#endif
@@ -0,0 +1,326 @@
+
+#include "tiled_image.h"
+#include "juliaset_batch.h"
+#include "palette.h"
+#include "render_pool.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//Seconds between checkpoints (and progress reports)
+static double const checkpoint_interval = 2.0;
+
+/* The .done file starts by this header, which must match the job being resumed,
+ followed by one byte per tile (nonzero once the tile is safely in the image file). */
+struct checkpoint_header {
+	char magic[8];
+	int width, height, precision, tile;
+	my_complex top_left, bottom_right, c;
+};
+static char const checkpoint_magic[8] = "JTILED2";
+
+//Mapped files and everything tile tasks need to know
+struct job {
+	struct tiled_image const* t;
+	int tiles_in_row, tiles_in_col;
+	double dx, dy;
+	bool use_float;
+	/* Mapped "<output>.tiles", every tile occupies a contiguous slot of tile x tile pixels
+	 (row by row, edge tiles use a part of it), so that computing a tile dirties its pages only */
+	uint8_t* tiles;
+	size_t tiles_size, slot_size;
+	uint8_t* done; //Mapped .done file including its header
+	size_t done_size;
+};
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_interrupt(int signal) {
+	interrupted = 1;
+}
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+//Takes every other bit of x (starting by the lowest one) and packs them together
+static uint32_t compact_bits(uint64_t x) {
+	x &= 0x5555555555555555ull;
+	x = (x | x >> 1) & 0x3333333333333333ull;
+	x = (x | x >> 2) & 0x0f0f0f0f0f0f0f0full;
+	x = (x | x >> 4) & 0x00ff00ff00ff00ffull;
+	x = (x | x >> 8) & 0x0000ffff0000ffffull;
+	x = (x | x >> 16) & 0x00000000ffffffffull;
+	return x;
+}
+
+//Address of pixel [x, y] of the image within the slot of its tile
+static uint8_t* tile_pixel(struct job const* j, int x, int y) {
+	int const side = j->t->tile;
+	long const tile = (long)(y / side) * j->tiles_in_row + x / side;
+	return j->tiles + tile * j->slot_size + 3 * ((size_t)(y % side) * side + x % side);
+}
+
+static void render_tile(int tile, int worker, void* arg) {
+	struct job const* const j = arg;
+	struct tiled_image const* const t = j->t;
+	int const x = tile % j->tiles_in_row * t->tile, y = tile / j->tiles_in_row * t->tile;
+	int const w = x + t->tile > t->width ? t->width - x : t->tile;
+	int const h = y + t->tile > t->height ? t->height - y : t->tile;
+	int iterations[w];
+	uint16_t counts[w];
+	for (int row = y; row < y + h; ++row) {
+		//Same points as if whole rows were computed (see convergence_test_row)
+		my_complex const start = { t->top_left.re, t->top_left.im - row * j->dy };
+		(j->use_float ? &convergence_test_row_float : &convergence_test_row)(start, j->dx, x, 1, w, t->c,
+			t->precision, 0.0, iterations, NULL);
+		for (int i = 0; i < w; ++i) {
+			counts[i] = iterations[i];
+		}
+		palette_color_counts(counts, w, tile_pixel(j, x, row));
+	}
+}
+
+//Maps the whole file. Returns NULL on failure.
+static uint8_t* map_file(int fd, size_t size) {
+	void* const data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	return data == MAP_FAILED ? NULL : data;
+}
+
+/* Opens (or creates) the .tiles and the .done file. Returns the number of tiles
+ already done by a former run of the same job, -1 on error. */
+static long open_files(struct job* j, char const* tiles_path, char const* done_path) {
+	struct tiled_image const* const t = j->t;
+	long const tiles = (long)j->tiles_in_row * j->tiles_in_col;
+	j->slot_size = 3 * (size_t)t->tile * t->tile;
+	j->tiles_size = j->slot_size * tiles;
+	j->done_size = sizeof(struct checkpoint_header) + tiles;
+
+	struct checkpoint_header expected;
+	memset(&expected, 0, sizeof expected);
+	memcpy(expected.magic, checkpoint_magic, sizeof checkpoint_magic);
+	expected.width = t->width;
+	expected.height = t->height;
+	expected.precision = t->precision;
+	expected.tile = t->tile;
+	expected.top_left = t->top_left;
+	expected.bottom_right = t->bottom_right;
+	expected.c = t->c;
+
+	//Resume only if both files belong to this very job
+	struct stat info;
+	int done_fd = open(done_path, O_RDWR);
+	int tiles_fd = done_fd == -1 ? -1 : open(tiles_path, O_RDWR);
+	bool resume = tiles_fd != -1 && !fstat(tiles_fd, &info) && (size_t)info.st_size == j->tiles_size
+		&& !fstat(done_fd, &info) && (size_t)info.st_size == j->done_size;
+	if (resume) {
+		j->tiles = map_file(tiles_fd, j->tiles_size);
+		j->done = map_file(done_fd, j->done_size);
+		resume = j->tiles && j->done && !memcmp(j->done, &expected, sizeof expected);
+	}
+	if (!resume) {
+		if (j->tiles) {
+			munmap(j->tiles, j->tiles_size);
+		}
+		if (j->done) {
+			munmap(j->done, j->done_size);
+		}
+		j->tiles = j->done = NULL;
+		if (tiles_fd != -1) {
+			close(tiles_fd);
+		}
+		if (done_fd != -1) {
+			close(done_fd);
+		}
+		tiles_fd = open(tiles_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		done_fd = open(done_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		//The file stays sparse until tiles are written
+		if (tiles_fd == -1 || done_fd == -1 || ftruncate(tiles_fd, j->tiles_size) || ftruncate(done_fd, j->done_size)
+			|| !(j->tiles = map_file(tiles_fd, j->tiles_size)) || !(j->done = map_file(done_fd, j->done_size))) {
+			fprintf(stderr, "ERROR: Cannot create %s or %s: %s.\r\n", tiles_path, done_path, strerror(errno));
+			if (tiles_fd != -1) {
+				close(tiles_fd);
+			}
+			if (done_fd != -1) {
+				close(done_fd);
+			}
+			return -1;
+		}
+		memcpy(j->done, &expected, sizeof expected);
+	}
+	close(tiles_fd); //Mappings stay valid
+	close(done_fd);
+
+	long finished = 0;
+	for (long i = 0; i < tiles; ++i) {
+		finished += j->done[sizeof expected + i] != 0;
+	}
+	return finished;
+}
+
+/* Makes tiles finished since the last checkpoint durable. Their pixels are flushed first,
+ so that a tile is never marked done before its pixels reach the disk. */
+static bool checkpoint(struct job* j, int const* tiles, int count) {
+	if (msync(j->tiles, j->tiles_size, MS_SYNC)) {
+		return false;
+	}
+	for (int i = 0; i < count; ++i) {
+		j->done[sizeof(struct checkpoint_header) + tiles[i]] = 1;
+	}
+	return !msync(j->done, j->done_size, MS_SYNC);
+}
+
+/* Writes the PPM file row by row, gathering each row from the tiles it crosses.
+ Returns false on error. */
+static bool assemble_image(struct job const* j) {
+	struct tiled_image const* const t = j->t;
+	FILE* const output = fopen(t->output, "wb");
+	uint8_t* const row_pixels = malloc(3 * (size_t)t->width);
+	bool ok = output && row_pixels && fprintf(output, "P6\n%d\n%d\n255\n", t->width, t->height) > 0;
+	for (int row = 0; ok && row < t->height; ++row) {
+		for (int x = 0; x < t->width; x += t->tile) {
+			int const w = x + t->tile > t->width ? t->width - x : t->tile;
+			memcpy(row_pixels + 3 * (size_t)x, tile_pixel(j, x, row), 3 * (size_t)w);
+		}
+		ok = fwrite(row_pixels, 3, t->width, output) == (size_t)t->width;
+	}
+	free(row_pixels);
+	if (output && fclose(output)) {
+		ok = false;
+	}
+	return ok;
+}
+
+static void print_progress(long done, long total, long done_now, double elapsed) {
+	double const rate = done_now / elapsed; //Tiles per second in this run
+	long const eta = rate > 0 ? (long)((total - done) / rate) : 0;
+	fprintf(stderr, "INFO: %5.1f %% done (%ld of %ld tiles), ETA %ld:%02ld:%02ld.\r\n",
+		100.0 * done / total, done, total, eta / 3600, eta / 60 % 60, eta % 60);
+}
+
+bool tiled_image_render(struct tiled_image const* t) {
+	if (t->width <= 0 || t->height <= 0 || t->tile <= 0 || t->precision < 1 || t->precision > UINT16_MAX) {
+		fprintf(stderr, "ERROR: Invalid image parameters.\r\n");
+		return false;
+	}
+	if (!palette_rebuild(t->precision)) {
+		return false;
+	}
+
+	struct job j;
+	memset(&j, 0, sizeof j);
+	j.t = t;
+	j.tiles_in_row = (t->width + t->tile - 1) / t->tile;
+	j.tiles_in_col = (t->height + t->tile - 1) / t->tile;
+	j.dx = (t->bottom_right.re - t->top_left.re) / t->width;
+	j.dy = (t->top_left.im - t->bottom_right.im) / t->height;
+	j.use_float = batch_float_sufficient(j.dx) && batch_float_sufficient(j.dy);
+	long const total = (long)j.tiles_in_row * j.tiles_in_col;
+
+	char done_path[strlen(t->output) + sizeof ".done"], tiles_path[strlen(t->output) + sizeof ".tiles"];
+	sprintf(done_path, "%s.done", t->output);
+	sprintf(tiles_path, "%s.tiles", t->output);
+	long const resumed = open_files(&j, tiles_path, done_path);
+	if (resumed < 0) {
+		palette_cleanup();
+		return false;
+	}
+
+	//Morton order over the smallest power of two square covering all tiles
+	int* const order = malloc(sizeof(int) * (total - resumed + 1));
+	long count = 0;
+	uint32_t side = 1;
+	while (side < (uint32_t)j.tiles_in_row || side < (uint32_t)j.tiles_in_col) {
+		side *= 2;
+	}
+	for (uint64_t code = 0; order && code < (uint64_t)side * side; ++code) {
+		uint32_t const x = compact_bits(code), y = compact_bits(code >> 1);
+		long const tile = (long)y * j.tiles_in_row + x;
+		if (x < (uint32_t)j.tiles_in_row && y < (uint32_t)j.tiles_in_col
+			&& !j.done[sizeof(struct checkpoint_header) + tile]) {
+			order[count++] = tile;
+		}
+	}
+
+	bool const own_pool = t->threads > 1 && pool_size() == 0 && pool_start(t->threads);
+	int const threads = pool_size() > 1 ? pool_size() : 1;
+	struct sigaction action, former;
+	memset(&action, 0, sizeof action);
+	action.sa_handler = &on_interrupt;
+	sigaction(SIGINT, &action, &former);
+	interrupted = 0;
+
+	if (resumed) {
+		fprintf(stderr, "INFO: Resuming %s, %ld of %ld tiles were done already.\r\n", t->output, resumed, total);
+	}
+	fprintf(stderr, "INFO: Rendering %dx%d image by %d px tiles using %d threads and %s kernel.\r\n",
+		t->width, t->height, t->tile, threads, batch_kernel_name(batch_get_kernel()));
+
+	bool ok = order != NULL;
+	double const start = now();
+	double last_checkpoint = start;
+	long next = 0, checkpointed = 0; //Tiles in 'order' computed and marked done so far
+	int const batch = 4 * threads; //Tiles computed between checks for interruption
+	while (ok && next < count && !interrupted) {
+		int const n = next + batch > count ? count - next : batch;
+		if (threads > 1) {
+			pool_run(order + next, n, &render_tile, &j);
+		}
+		else {
+			for (int i = 0; i < n; ++i) {
+				render_tile(order[next + i], 0, &j);
+			}
+		}
+		next += n;
+		if (now() - last_checkpoint >= checkpoint_interval) {
+			ok = checkpoint(&j, order + checkpointed, next - checkpointed);
+			checkpointed = next;
+			last_checkpoint = now();
+			print_progress(resumed + next, total, next, last_checkpoint - start);
+		}
+	}
+	if (ok && checkpointed < next) {
+		ok = checkpoint(&j, order + checkpointed, next - checkpointed);
+	}
+	if (!ok) {
+		fprintf(stderr, "ERROR: Cannot write %s: %s.\r\n", t->output, strerror(errno));
+	}
+	else if (next < count) {
+		fprintf(stderr, "INFO: Interrupted with %ld of %ld tiles done, run the same job again to resume.\r\n",
+			resumed + next, total);
+		ok = false;
+	}
+	else if (!assemble_image(&j)) {
+		//Tiles stay on disk, running the job again only assembles the image
+		fprintf(stderr, "ERROR: Cannot write %s: %s.\r\n", t->output, strerror(errno));
+		ok = false;
+	}
+	else {
+		double const elapsed = now() - start;
+		fprintf(stderr, "INFO: Rendered %ld tiles in %.3f s (%.1f Mpixels/s), saved as %s.\r\n", count, elapsed,
+			(double)t->width * t->height * (total - resumed) / total * 1e-6 / elapsed, t->output);
+		unlink(done_path);
+		unlink(tiles_path);
+	}
+
+	sigaction(SIGINT, &former, NULL);
+	if (own_pool) {
+		pool_stop();
+	}
+	munmap(j.tiles, j.tiles_size);
+	munmap(j.done, j.done_size);
+	free(order);
+	palette_cleanup();
+	return ok;
+}
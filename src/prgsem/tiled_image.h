@@ -0,0 +1,25 @@
+#ifndef TILED_IMAGE_H
+#define TILED_IMAGE_H
+
+#include <stdbool.h>
+#include "juliaset.h"
+
+/* Headless render of a huge image (e.g. for print) by tiles kept in a memory mapped file. */
+struct tiled_image {
+	int width, height, precision;
+	int tile; //Side of square tiles in pixels
+	my_complex top_left, bottom_right, c;
+	/* Path of the PPM file. Until the image is complete, pixels of tiles are kept in
+	 "<output>.tiles" and finished tiles are recorded in "<output>.done". */
+	char const* output;
+	int threads; //Threads computing tiles
+};
+
+/* Render tiles in Morton (Z) order. Every tile is a contiguous block of the .tiles file, so that
+ a tile dirties only its own pages. Finished tiles are checkpointed to "<output>.done" every few
+ seconds and when interrupted by SIGINT. Running the same job again resumes it, tiles done are
+ not recomputed. Once all tiles are done, the PPM file is assembled from them row by row and both
+ auxiliary files are removed. Prints progress and ETA to stderr. Returns false on error or interruption. */
+bool tiled_image_render(struct tiled_image const* t);
+
+#endif